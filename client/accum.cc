@@ -5,79 +5,161 @@
 
 #include "accum.hh"
 
-// TODO: Histogram rather than all samples?
-
 using namespace std;
 
 void Accum::clear(void)
 {
     samples_.clear();
-    sorted_ = false;
+    hist_.clear();
+    mean_ = 0;
+    m2_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
 }
 
 void Accum::add_sample(uint64_t val)
 {
-    samples_.push_back(val);
-    sorted_ = false;
+    if (use_hist_) {
+        hist_.add_sample(val);
+    } else {
+        samples_.push_back(val);
+
+        double delta = double(val) - mean_;
+        mean_ += delta / samples_.size();
+        m2_ += delta * (double(val) - mean_);
+        min_ = std::min(min_, val);
+        max_ = std::max(max_, val);
+    }
+}
+
+void Accum::merge(const Accum &other)
+{
+    if (use_hist_) {
+        hist_.merge(other.histogram(hist_.precision()));
+    } else if (other.use_hist_) {
+        // can't recover raw samples, so switch to keeping a histogram, at
+        // the other's precision so theirs isn't degraded
+        hist_ = histogram(other.hist_.precision());
+        hist_.merge(other.hist_);
+        samples_.clear();
+        use_hist_ = true;
+    } else if (not other.samples_.empty()) {
+        // combine running statistics (Chan et al.)
+        double n1 = samples_.size(), n2 = other.samples_.size();
+        double delta = other.mean_ - mean_;
+        mean_ += delta * n2 / (n1 + n2);
+        m2_ += other.m2_ + delta * delta * n1 * n2 / (n1 + n2);
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+
+        samples_.insert(samples_.end(), other.samples_.begin(),
+                        other.samples_.end());
+    }
 }
 
 void Accum::print_samples(void)
 {
+    if (use_hist_) {
+        hist_.print_samples();
+        return;
+    }
     for (auto i : samples_) {
-        cout << i << endl;
+        cout << i << '\n';
     }
+    cout.flush();
 }
 
-double Accum::mean(void)
+/**
+ * The samples as a histogram.
+ * @precision: of the histogram when keeping every sample (0 for default).
+ */
+Histogram Accum::histogram(unsigned int precision) const
 {
-    double avg = 0;
-    double sz = size();
-
+    if (use_hist_) {
+        return hist_;
+    }
+    Histogram h{precision > 0 ? precision : hist_.precision()};
     for (auto i : samples_) {
-        avg += double(i) / sz;
+        h.add_sample(i);
     }
+    return h;
+}
 
-    return avg;
+double Accum::mean(void)
+{
+    return use_hist_ ? hist_.mean() : mean_;
 }
 
 double Accum::stddev(void)
 {
-    double avg = mean();
-    double sum = 0;
-
-    for (auto i : samples_) {
-        double diff = double(i) - avg;
-        sum += diff * diff;
+    if (use_hist_) {
+        return hist_.stddev();
+    } else if (samples_.empty()) {
+        return 0;
     }
-
-    return sqrt(sum / size());
+    return sqrt(m2_ / size());
 }
 
 uint64_t Accum::percentile(double percent)
 {
-    if (not sorted_) {
-        sort(samples_.begin(), samples_.end());
-        sorted_ = true;
+    return percentiles({percent})[0];
+}
+
+/**
+ * Find several percentiles at once. Each is found by selection within what's
+ * left above the previous (lower) one, so the total cost is linear in the
+ * number of samples, however many percentiles are asked for.
+ * @percents: the percentiles to find, as fractions.
+ * @return: the value of each percentile, in the order asked for.
+ */
+vector<uint64_t> Accum::percentiles(initializer_list<double> percents)
+{
+    vector<double> pcts{percents};
+    vector<uint64_t> vals(pcts.size(), 0);
+    if (use_hist_) {
+        for (size_t i = 0; i < pcts.size(); i++) {
+            vals[i] = hist_.percentile(pcts[i]);
+        }
+        return vals;
+    } else if (samples_.empty()) {
+        return vals;
+    }
+
+    vector<size_t> order(pcts.size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(),
+         [&pcts](size_t a, size_t b) { return pcts[a] < pcts[b]; });
+
+    auto from = samples_.begin();
+    for (size_t i : order) {
+        size_t rank = std::max(ceil(double(size()) * pcts[i]), 1.0) - 1;
+        auto nth = samples_.begin() + std::min(rank, size() - 1);
+        if (nth >= from) {
+            nth_element(from, nth, samples_.end());
+            from = nth + 1;
+        }
+        vals[i] = *nth;
     }
-    return samples_[ceil(double(size()) * percent) - 1];
+    return vals;
 }
 
 uint64_t Accum::min(void)
 {
-    if (not sorted_) {
-        sort(samples_.begin(), samples_.end());
-        sorted_ = true;
+    if (use_hist_) {
+        return hist_.min();
     }
-    return samples_[0];
+    return samples_.empty() ? 0 : min_;
 }
 
 uint64_t Accum::max(void)
 {
-    if (not sorted_) {
-        sort(samples_.begin(), samples_.end());
-        sorted_ = true;
+    if (use_hist_) {
+        return hist_.max();
     }
-    return samples_[samples_.size() - 1];
+    return max_;
 }
 
-vector<uint64_t>::size_type Accum::size(void) { return samples_.size(); }
+vector<uint64_t>::size_type Accum::size(void)
+{
+    return use_hist_ ? hist_.size() : samples_.size();
+}
@@ -2,24 +2,57 @@
 #define MUTATED_ACCUM_HH
 
 #include <cstdint>
+#include <initializer_list>
 #include <vector>
 
+#include "histogram.hh"
+
 /**
  * A sample accumulator container.
+ *
+ * Keeps either every sample, or (when given a precision) only a histogram of
+ * them, in which case memory use and the cost of reporting are independent of
+ * the number of samples, at the cost of reporting values to within a relative
+ * error of 2^-precision.
+ *
+ * When keeping every sample, the mean, variance (Welford's method), min and
+ * max are maintained as samples are added, and percentiles are found by
+ * selection rather than sorting, so reporting takes linear time.
  */
 class Accum
 {
   private:
     std::vector<uint64_t> samples_;
-    bool sorted_;
+    bool use_hist_;
+    Histogram hist_;
+
+    /* Running statistics of samples_ */
+    double mean_;
+    double m2_; /* sum of squared differences from the mean */
+    uint64_t min_;
+    uint64_t max_;
 
   public:
     using size_type = std::vector<uint64_t>::size_type;
 
-    Accum(void) noexcept : samples_{}, sorted_{false} {}
+    Accum(void) noexcept : samples_{},
+                           use_hist_{false},
+                           hist_{},
+                           mean_{0},
+                           m2_{0},
+                           min_{UINT64_MAX},
+                           max_{0}
+    {
+    }
 
-    explicit Accum(std::size_t reserve) noexcept : samples_{reserve},
-                                                   sorted_{false}
+    explicit Accum(std::size_t reserve, unsigned int precision = 0) noexcept
+      : samples_{precision > 0 ? 0 : reserve},
+        use_hist_{precision > 0},
+        hist_{precision > 0 ? precision : 5},
+        mean_{0},
+        m2_{0},
+        min_{UINT64_MAX},
+        max_{0}
     {
         // we want to zero out the memory to ensure it's paged in, but we still
         // want to use the push_back operator for its bounds-checking a growth.
@@ -30,11 +63,16 @@ class Accum
 
     void clear(void);
     void add_sample(uint64_t val);
+    void merge(const Accum &other);
     void print_samples(void);
 
+    /* The samples as a histogram (at its own precision if keeping one) */
+    Histogram histogram(unsigned int precision = 0) const;
+
     double mean(void);
     double stddev(void);
     uint64_t percentile(double percent);
+    std::vector<uint64_t> percentiles(std::initializer_list<double> percents);
     uint64_t min(void);
     uint64_t max(void);
     size_type size(void);
@@ -2,20 +2,25 @@
 #define MUTATED_BUFFER_HH
 
 /**
- * buffer.hh - circular buffer / queue implementation, allows inserting and
+ * buffer.hh - circular buffer / queue implementations, allow inserting and
  * removing items in FIFO order.
  *
  * NOTE: we use lowercase here against our usual convention to match C++ STL.
  */
 
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <deque>
 #include <iterator>
 #include <memory>
 #include <stdexcept>
 #include <system_error>
+#include <type_traits>
 #include <utility>
 
 #include "limits.hh"
+#include "pool.hh"
 
 /**
  * A buffer iterator.
@@ -110,8 +115,14 @@ class buffer_iterator
 /**
  * A circular buffer / queue, not thread-safe, only useful from one thread.
  * Allows inserting and removing items in FIFO order.
+ *
+ * Storage comes from the thread's BlockPool and grows on demand, up to BUFSZ
+ * items, by moving the items to a larger block. Once empty, the buffer gives
+ * back any block larger than that holding MINSZ items when next queued to. So
+ * pointers into the buffer are only valid until the next queue operation.
  */
-template <typename T, std::size_t BUFSZ = 1024> class buffer
+template <typename T, std::size_t BUFSZ = 1024, std::size_t MINSZ = 1>
+class buffer
 {
   public:
     using value_type = T;
@@ -123,21 +134,81 @@ template <typename T, std::size_t BUFSZ = 1024> class buffer
     using size_type = std::size_t;
 
   private:
-    value_type buf_[BUFSZ]; // buffer for storage
-    pointer head_;          // head of queue (at-current pointer)
-    pointer tail_;          // tail of queue (1-past pointer)
+    pointer buf_;    // storage, from the block pool
+    size_type cap_;  // items the storage holds
+    pointer head_;   // head of queue (at-current pointer)
+    pointer tail_;   // tail of queue (1-past pointer)
     size_type used_;
 
-    const_pointer bufcap(void) const noexcept { return buf_ + BUFSZ; }
+    const_pointer bufcap(void) const noexcept { return buf_ + cap_; }
+
+    /* Items a block allocated to hold n items can hold */
+    static size_type block_items(size_type n) noexcept
+    {
+        return std::min(BlockPool::block_size(n * sizeof(T)) / sizeof(T),
+                        BUFSZ);
+    }
+
+    /* Move our items to storage for at least n items, or free it if n = 0 */
+    void resize(size_type n)
+    {
+        pointer nbuf = nullptr;
+        size_type ncap = 0;
+        if (n > 0) {
+            ncap = block_items(n);
+            nbuf = static_cast<pointer>(
+              BlockPool::local().alloc(ncap * sizeof(T)));
+            if (not std::is_trivially_default_constructible<T>::value) {
+                for (size_type i = 0; i < ncap; i++) {
+                    ::new (static_cast<void *>(nbuf + i)) value_type;
+                }
+            }
+            if (used_ > 0) {
+                size_type n1 = used_;
+                auto ptrs = peek(n1);
+                std::move(ptrs.first, ptrs.first + n1, nbuf);
+                if (ptrs.second != nullptr) {
+                    std::move(ptrs.second, ptrs.second + used_ - n1,
+                              nbuf + n1);
+                }
+            }
+        }
+
+        if (buf_ != nullptr) {
+            if (not std::is_trivially_destructible<T>::value) {
+                for (size_type i = 0; i < cap_; i++) {
+                    buf_[i].~value_type();
+                }
+            }
+            BlockPool::local().free(buf_, cap_ * sizeof(T));
+        }
+        buf_ = nbuf;
+        cap_ = ncap;
+        head_ = buf_;
+        tail_ = buf_ + used_;
+        if (used_ == cap_) {
+            tail_ = buf_;
+        }
+    }
 
   public:
     /**
      * Construct a new circular buffer.
      */
-    buffer(void) noexcept : head_{buf_}, tail_{buf_}, used_{0} {}
+    buffer(void) noexcept : buf_{nullptr},
+                            cap_{0},
+                            head_{nullptr},
+                            tail_{nullptr},
+                            used_{0}
+    {
+    }
 
     /* Deconstruct a circular buffer. */
-    ~buffer(void) noexcept {}
+    ~buffer(void) noexcept
+    {
+        used_ = 0;
+        resize(0);
+    }
 
     /* Don't allow copy or move */
     buffer(const buffer &) = delete;
@@ -145,19 +216,41 @@ template <typename T, std::size_t BUFSZ = 1024> class buffer
     buffer operator=(const buffer &) = delete;
     buffer operator=(buffer &&) = delete;
 
-    /* Size returns the size of the circular buffer. */
+    /* Size returns the size the circular buffer can grow to. */
     size_type size(void) const noexcept { return BUFSZ; }
 
+    /* Capacity returns the size of the circular buffer's current storage. */
+    size_type capacity(void) const noexcept { return cap_; }
+
     /* Items returns the number of items stored in the circular buffer. */
     size_type items(void) const noexcept { return used_; }
 
-    /* Space returns the available free slots in the circular buffer. */
+    /* Space returns the free slots the circular buffer can grow to. */
     size_type space(void) const noexcept { return BUFSZ - used_; }
 
+    /* Room returns the free slots in the current storage, without growing. */
+    size_type room(void) const noexcept { return cap_ - used_; }
+
+    /**
+     * Reserve grows the storage so there is room for at least len more items,
+     * at least doubling it.
+     * @len: the number of items to make room for.
+     */
+    void reserve(const size_type len)
+    {
+        if (len > space()) {
+            throw std::system_error(ENOSPC, std::system_category(),
+                                    "buffer::reserve: not enough buffer space");
+        } else if (len > room()) {
+            resize(std::max(std::max(used_ + len, cap_ * 2), MINSZ));
+        }
+    }
+
     /**
      * Queue_prep prepares a queue operation by returning a pair of pointers
-     * that satisfies the request len of the circular buffer. The length of the
-     * array pointed to by the first element of the pair is returned by len.
+     * that satisfies the request len of the circular buffer, growing it if
+     * needed. The length of the array pointed to by the first element of the
+     * pair is returned by len.
      * @len: the space requested to queue items.
      * @return: a pair of pointers satisfying the request, the length of the
      * first array is returned by len, the second array will be null or the
@@ -174,13 +267,21 @@ template <typename T, std::size_t BUFSZ = 1024> class buffer
             throw std::system_error(
               ENOSPC, std::system_category(),
               "buffer::queue_prep: not enough buffer space ");
+        } else if (used_ == 0) {
+            // start from the front again, and give back a large block when a
+            // small one will do
+            if (cap_ > block_items(MINSZ) and len <= block_items(MINSZ)) {
+                resize(0);
+            }
+            head_ = tail_ = buf_;
         }
+        reserve(len);
 
         pointer p1 = tail_;
         pointer p2 = nullptr;
         if (head_ <= tail_) {
             size_type avail = size_type(bufcap() - tail_);
-            if (len >= avail) {
+            if (len > avail) {
                 len = avail;
                 p2 = buf_;
             }
@@ -197,10 +298,10 @@ template <typename T, std::size_t BUFSZ = 1024> class buffer
     {
         if (len == 0) {
             throw std::invalid_argument("buffer::queue_commit: len = 0");
-        } else if (used_ == BUFSZ) {
+        } else if (used_ == cap_) {
             throw std::system_error(ENOSPC, std::system_category(),
                                     "buffer::queue_commit: buffer full");
-        } else if (len > space()) {
+        } else if (len > room()) {
             throw std::system_error(
               ENOSPC, std::system_category(),
               "buffer::queue_commit: not enough buffer space ");
@@ -261,7 +362,7 @@ template <typename T, std::size_t BUFSZ = 1024> class buffer
         }
 
         if (tail_ == buf_) {
-            return const_cast<pointer>(buf_ + BUFSZ - 1);
+            return const_cast<pointer>(buf_ + cap_ - 1);
         } else {
             return tail_ - 1;
         }
@@ -389,8 +490,495 @@ template <typename T, std::size_t BUFSZ = 1024> class buffer
 };
 
 /**
- * A character buffer is a buffer storing char's.
+ * A block queue iterator, by position in the queue so it stays valid while
+ * items are queued.
+ */
+template <typename Q> class block_queue_iterator
+{
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename Q::value_type;
+    using pointer = value_type *;
+    using reference = value_type &;
+    using size_type = std::size_t;
+
+  private:
+    const Q *q_;
+    size_type i_;
+
+  public:
+    block_queue_iterator(void) noexcept : q_{nullptr}, i_{0} {}
+    block_queue_iterator(const Q *q, size_type i) noexcept : q_{q}, i_{i} {}
+
+    block_queue_iterator(const block_queue_iterator &) = default;
+    block_queue_iterator &operator=(const block_queue_iterator &) = default;
+
+    ~block_queue_iterator(void) noexcept {}
+
+    reference operator*(void) const { return q_->at(i_); }
+    pointer operator->(void) const { return &q_->at(i_); }
+
+    block_queue_iterator &operator++(void) // pre-increment
+    {
+        i_++;
+        return *this;
+    }
+
+    block_queue_iterator operator++(int) // post-increment
+    {
+        block_queue_iterator tmp(*this);
+        i_++;
+        return tmp;
+    }
+
+    block_queue_iterator &operator--(void) // pre-decrement
+    {
+        i_--;
+        return *this;
+    }
+
+    block_queue_iterator operator--(int) // post-decrement
+    {
+        block_queue_iterator tmp(*this);
+        i_--;
+        return tmp;
+    }
+
+    bool operator==(const block_queue_iterator &bi) const noexcept
+    {
+        return q_ == bi.q_ && i_ == bi.i_;
+    }
+
+    bool operator!=(const block_queue_iterator &bi) const noexcept
+    {
+        return !(*this == bi);
+    }
+};
+
+/**
+ * A FIFO queue of at most MAXITEMS items, not thread-safe, stored in fixed
+ * size blocks from the thread's BlockPool, taken as items are queued and
+ * given back as they are dropped. Unlike a buffer, items never move, so they
+ * can be referred to by address for as long as they are queued. A dropped
+ * item stays intact until a block's worth more items have been queued.
+ */
+template <typename T, std::size_t MAXITEMS = 1024> class block_queue
+{
+  public:
+    using value_type = T;
+    using pointer = T *;
+    using reference = T &;
+    using iterator = block_queue_iterator<block_queue>;
+    using size_type = std::size_t;
+
+    /* Items per block */
+    static constexpr size_type BLOCK =
+      std::max(POOL_BLOCK_SIZE / sizeof(T), size_type(16));
+
+  private:
+    std::deque<pointer> blocks_; // blocks in use, oldest first
+    pointer spare_;              // last block emptied, reused next
+    size_type head_;             // index of the first item in the first block
+    size_type used_;
+
+    static pointer alloc_block(void)
+    {
+        pointer b = static_cast<pointer>(
+          BlockPool::local().alloc(BLOCK * sizeof(T)));
+        for (size_type i = 0; i < BLOCK; i++) {
+            ::new (static_cast<void *>(b + i)) value_type;
+        }
+        return b;
+    }
+
+    static void free_block(pointer b) noexcept
+    {
+        for (size_type i = 0; i < BLOCK; i++) {
+            b[i].~value_type();
+        }
+        BlockPool::local().free(b, BLOCK * sizeof(T));
+    }
+
+  public:
+    /**
+     * Construct a new (empty) block queue.
+     */
+    block_queue(void) noexcept : blocks_{},
+                                 spare_{nullptr},
+                                 head_{0},
+                                 used_{0}
+    {
+    }
+
+    /* Deconstruct a block queue. */
+    ~block_queue(void) noexcept
+    {
+        for (pointer b : blocks_) {
+            free_block(b);
+        }
+        if (spare_ != nullptr) {
+            free_block(spare_);
+        }
+    }
+
+    /* Don't allow copy or move */
+    block_queue(const block_queue &) = delete;
+    block_queue(block_queue &&) = delete;
+    block_queue operator=(const block_queue &) = delete;
+    block_queue operator=(block_queue &&) = delete;
+
+    /* Items returns the number of items in the queue. */
+    size_type items(void) const noexcept { return used_; }
+
+    /* Space returns the number of items that can still be queued. */
+    size_type space(void) const noexcept { return MAXITEMS - used_; }
+
+    /* At returns the item at a position in the queue (0 is the first). */
+    reference at(size_type i) const noexcept
+    {
+        i += head_;
+        return blocks_[i / BLOCK][i % BLOCK];
+    }
+
+    /**
+     * Queue returns the (default-constructed or previously used) item at the
+     * end of the queue, to be assigned to.
+     * @len: must be 1; returned as 1.
+     * @return: the item.
+     */
+    pointer queue(size_type &len)
+    {
+        if (len != 1) {
+            throw std::invalid_argument("block_queue::queue: len != 1");
+        } else if (used_ == MAXITEMS) {
+            throw std::system_error(ENOSPC, std::system_category(),
+                                    "block_queue::queue: queue full");
+        }
+
+        size_type i = head_ + used_;
+        if (i == blocks_.size() * BLOCK) {
+            if (spare_ != nullptr) {
+                blocks_.push_back(spare_);
+                spare_ = nullptr;
+            } else {
+                blocks_.push_back(alloc_block());
+            }
+        }
+        used_++;
+        return &blocks_[i / BLOCK][i % BLOCK];
+    }
+
+    /**
+     * Queue_emplace constructs a new item on the end of the queue in-place
+     * through the use of placement-new.
+     * @args: arguments to forward to the constructor of the item.
+     */
+    template <class... Args> reference queue_emplace(Args &&... args)
+    {
+        size_type n = 1;
+        pointer p = queue(n);
+        ::new (static_cast<void *>(p)) value_type(std::forward<Args>(args)...);
+        return *p;
+    }
+
+    /**
+     * Drop drops len items from the start of the queue.
+     * @len: the number of items to drop.
+     */
+    void drop(const size_type len)
+    {
+        if (len == 0) {
+            return;
+        } else if (len > used_) {
+            throw std::system_error(ENOSPC, std::system_category(),
+                                    "block_queue::drop: not enough items");
+        }
+
+        head_ += len;
+        used_ -= len;
+        while (head_ >= BLOCK) {
+            // keep the newly emptied block, as a dropped item may still be in
+            // use, and give back the one we kept before
+            if (spare_ != nullptr) {
+                free_block(spare_);
+            }
+            spare_ = blocks_.front();
+            blocks_.pop_front();
+            head_ -= BLOCK;
+        }
+    }
+
+    /**
+     * Clear removes all items from the queue.
+     */
+    void clear(void) { drop(items()); }
+
+    /**
+     * Dequeue_one dequeues the first item in the queue.
+     * @return: the item, intact until a block's worth more are queued.
+     */
+    reference dequeue_one(void)
+    {
+        if (used_ == 0) {
+            throw std::system_error(ENOSPC, std::system_category(),
+                                    "block_queue::dequeue_one: queue empty");
+        }
+        reference r = at(0);
+        drop(1);
+        return r;
+    }
+
+    /**
+     * Begin returns an iterator pointing to the start of the queue.
+     */
+    iterator begin(void) const noexcept { return iterator(this, 0); }
+
+    /**
+     * End returns an iterator pointing to one-past the end of the queue.
+     */
+    iterator end(void) const noexcept { return iterator(this, used_); }
+};
+
+/**
+ * A ring buffer of chars, not thread-safe, in a mirrored block from the
+ * thread's BlockPool: its memory is mapped twice back-to-back, so the queued
+ * chars, and the free space after them, are always one contiguous array even
+ * when they wrap around. Grows on demand like a buffer, from MINSZ up to
+ * BUFSZ chars, and gives back a large block when empty and next queued to a
+ * small amount (or shrunk). Pointers into it are only valid until the next queue
+ * operation.
+ */
+template <std::size_t BUFSZ, std::size_t MINSZ> class ringbuf
+{
+  public:
+    using size_type = std::size_t;
+
+  private:
+    char *buf_;      // storage, mapped twice from buf_ to buf_ + 2 * cap_
+    size_type cap_;  // chars the storage holds
+    size_type head_; // offset of the head of the queue
+    size_type used_;
+    bool pinned_;        // is the storage in use outside of us?
+    char *retired_;      // storage moved from while pinned, until unpinned
+    size_type retired_cap_;
+
+    /* Move our chars to storage for at least n, or free it if n = 0 */
+    void resize(size_type n)
+    {
+        char *nbuf = nullptr;
+        size_type ncap = 0;
+        if (n > 0) {
+            ncap = BlockPool::mirrored_size(n);
+            nbuf = static_cast<char *>(BlockPool::local().alloc_mirrored(ncap));
+            if (used_ > 0) {
+                memcpy(nbuf, buf_ + head_, used_);
+            }
+        }
+
+        if (buf_ != nullptr and pinned_ and retired_ == nullptr) {
+            retired_ = buf_;
+            retired_cap_ = cap_;
+        } else if (buf_ != nullptr) {
+            BlockPool::local().free_mirrored(buf_, cap_);
+        }
+        buf_ = nbuf;
+        cap_ = ncap;
+        head_ = 0;
+    }
+
+  public:
+    /**
+     * Construct a new (empty) ring buffer.
+     */
+    ringbuf(void) noexcept : buf_{nullptr},
+                             cap_{0},
+                             head_{0},
+                             used_{0},
+                             pinned_{false},
+                             retired_{nullptr},
+                             retired_cap_{0}
+    {
+    }
+
+    /* Deconstruct a ring buffer. */
+    ~ringbuf(void) noexcept
+    {
+        used_ = 0;
+        unpin();
+        resize(0);
+    }
+
+    /* Don't allow copy or move */
+    ringbuf(const ringbuf &) = delete;
+    ringbuf(ringbuf &&) = delete;
+    ringbuf operator=(const ringbuf &) = delete;
+    ringbuf operator=(ringbuf &&) = delete;
+
+    /* Size returns the size the ring buffer can grow to. */
+    size_type size(void) const noexcept { return BUFSZ; }
+
+    /* Capacity returns the size of the ring buffer's current storage. */
+    size_type capacity(void) const noexcept { return cap_; }
+
+    /* Items returns the number of chars queued. */
+    size_type items(void) const noexcept { return used_; }
+
+    /* Space returns the free chars the ring buffer can grow to. */
+    size_type space(void) const noexcept { return BUFSZ - used_; }
+
+    /* Room returns the free chars in the current storage, without growing. */
+    size_type room(void) const noexcept
+    {
+        return std::min(cap_, BUFSZ) - used_;
+    }
+
+    /**
+     * Reserve grows the storage so there is room for at least len more chars,
+     * at least doubling it.
+     * @len: the number of chars to make room for.
+     */
+    void reserve(const size_type len)
+    {
+        if (len > space()) {
+            throw std::system_error(
+              ENOSPC, std::system_category(),
+              "ringbuf::reserve: not enough buffer space");
+        } else if (len > room()) {
+            resize(std::max(std::max(used_ + len, cap_ * 2), MINSZ));
+        }
+    }
+
+    /**
+     * Queue_prep prepares a queue operation, growing the buffer if needed.
+     * @len: the space requested to queue chars.
+     * @return: a contiguous array of len chars at the end of the queue.
+     */
+    char *queue_prep(const size_type len)
+    {
+        if (len == 0) {
+            throw std::invalid_argument("ringbuf::queue_prep: len = 0");
+        } else if (used_ == 0 and cap_ > BlockPool::mirrored_size(MINSZ) and
+                   len <= BlockPool::mirrored_size(MINSZ)) {
+            // give back a large block when a small one will do
+            resize(0);
+        }
+        reserve(len);
+        return buf_ + (head_ + used_) % cap_;
+    }
+
+    /**
+     * Queue_commit finalizes a previously prepared queue (queue_prep),
+     * marking that amount of space as queued / in-use.
+     * @len: the amount of space to regard as committed.
+     */
+    void queue_commit(const size_type len)
+    {
+        if (len == 0) {
+            throw std::invalid_argument("ringbuf::queue_commit: len = 0");
+        } else if (len > room()) {
+            throw std::system_error(
+              ENOSPC, std::system_category(),
+              "ringbuf::queue_commit: not enough buffer space");
+        }
+        used_ += len;
+    }
+
+    /**
+     * Peek returns the chars at the head of the queue.
+     * @len: the number of chars wanted.
+     * @return: a contiguous array of len chars.
+     */
+    char *peek(const size_type len) const
+    {
+        if (len > used_) {
+            throw std::system_error(ENOSPC, std::system_category(),
+                                    "ringbuf::peek: not enough items");
+        }
+        return buf_ + head_;
+    }
+
+    /**
+     * Drop drops len chars from the start of the queue.
+     * @len: the number of chars to drop.
+     */
+    void drop(const size_type len)
+    {
+        if (len > used_) {
+            throw std::system_error(ENOSPC, std::system_category(),
+                                    "ringbuf::drop: not enough items");
+        }
+        used_ -= len;
+        head_ = used_ == 0 ? 0 : (head_ + len) % cap_;
+    }
+
+    /**
+     * Clear removes all chars from the ring buffer.
+     */
+    void clear(void) { drop(items()); }
+
+    /**
+     * Shrink gives back a large block if the buffer is empty (and not
+     * pinned), so that a burst doesn't hold memory once it has drained.
+     */
+    void shrink(void) noexcept
+    {
+        if (used_ == 0 and not pinned_ and
+            cap_ > BlockPool::mirrored_size(MINSZ)) {
+            resize(0);
+        }
+    }
+
+    /**
+     * Pin keeps the chars currently queued where they are (e.g., while the
+     * kernel reads them asynchronously) until unpinned, even if the buffer
+     * grows meanwhile. They must not be dropped while pinned.
+     */
+    void pin(void) noexcept { pinned_ = true; }
+
+    /**
+     * Unpin releases pinned chars, and any storage kept for them.
+     */
+    void unpin(void) noexcept
+    {
+        pinned_ = false;
+        if (retired_ != nullptr) {
+            BlockPool::local().free_mirrored(retired_, retired_cap_);
+            retired_ = nullptr;
+        }
+    }
+
+    /**
+     * Disown unpins the buffer, handing the storage of the pinned chars over
+     * to the caller, who gives it back to the BlockPool once they're no
+     * longer in use. Drops all chars if that's the current storage.
+     * @cap: set to the capacity of the storage.
+     * @return: the storage, or null if nothing was pinned.
+     */
+    char *disown(size_type &cap) noexcept
+    {
+        char *block = nullptr;
+        cap = 0;
+        if (retired_ != nullptr) {
+            block = retired_;
+            cap = retired_cap_;
+            retired_ = nullptr;
+        } else if (pinned_ and buf_ != nullptr) {
+            block = buf_;
+            cap = cap_;
+            buf_ = nullptr;
+            cap_ = 0;
+            head_ = 0;
+            used_ = 0;
+        }
+        pinned_ = false;
+        return block;
+    }
+};
+
+/**
+ * A character buffer is a ring buffer storing char's.
  */
-using charbuf = buffer<char, CHARBUF_SIZE>;
+using charbuf = ringbuf<CHARBUF_SIZE, CHARBUF_MIN>;
 
 #endif /* MUTATED_BUFFER_HH */
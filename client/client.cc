@@ -1,14 +1,20 @@
-#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <exception>
 #include <functional>
 #include <string>
+#include <thread>
 
 #include <inttypes.h>
 #include <fcntl.h>
+#include <sys/resource.h>
 
 #include "client.hh"
 #include "gen_memcache.hh"
 #include "gen_synthetic.hh"
 #include "generator.hh"
+#include "histfile.hh"
+#include "limits.hh"
 #include "linux_compat.hh"
 #include "socket_buf.hh"
 #include "util.hh"
@@ -16,33 +22,146 @@
 using namespace std;
 using namespace std::placeholders;
 
+/**
+ * Split a total among shards, handing any remainder to the lowest shards.
+ */
+static uint64_t shard_share(uint64_t total, uint64_t shards,
+                            unsigned int shard)
+{
+    return total / shards + (shard < total % shards ? 1 : 0);
+}
+
+/**
+ * The name of a shard's own copy of a per-shard file, or empty if none.
+ */
+static string shard_file(const char *file, uint64_t shards, unsigned int shard)
+{
+    if (file == nullptr) {
+        return "";
+    } else if (shards == 1) {
+        return file;
+    } else {
+        return string(file) + "." + to_string(shard);
+    }
+}
+
+/**
+ * CPU time (user and system) used by the process so far, in seconds.
+ */
+static double cpu_seconds(void)
+{
+    rusage ru;
+    system_call(getrusage(RUSAGE_SELF, &ru), "cpu_seconds: getrusage()");
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Name of a memcache operation, for reporting.
+ */
+static const char *op_name(unsigned int op)
+{
+    switch (static_cast<MemcCmd>(op)) {
+    case MemcCmd::Get:
+        return "get";
+    case MemcCmd::Set:
+        return "set";
+    default:
+        return "?";
+    }
+}
+
+/**
+ * Print a row of summary statistics (min, avg, std, 99th, 99.9th, max) of a
+ * set of samples.
+ */
+static void print_stats(Accum &acc)
+{
+    auto pct = acc.percentiles({0.99, 0.999});
+    printf("         %" PRIu64 "\t%f\t%f\t%" PRIu64 "\t%" PRIu64
+           "\t%" PRIu64 "\n",
+           acc.min(), acc.mean(), acc.stddev(), pct[0], pct[1], acc.max());
+}
+
 /**
  * Create a new client.
+ * @c: the experiment configuration.
+ * @shard: which of the `c.threads` event loops this client is.
  */
-Client::Client(Config c)
+Client::Client(Config c, unsigned int shard)
   : cfg_{c}
+  , shard_{shard}
+  , req_s_{cfg_.req_s / cfg_.threads}
+  , samples_{shard_share(cfg_.samples, cfg_.threads, shard)}
+  , conn_cnt_{shard_share(cfg_.conn_cnt, cfg_.threads, shard)}
   , rd_{}
   , randgen_{rd_()}
-  , conn_dist_{0, (int)cfg_.conn_cnt - 1}
-  , gen_cb_{bind(&Client::record_sample, this, _1, _2, _3, _4, _5, _6)}
+  , conn_dist_{0, (int)conn_cnt_ - 1}
+  , gen_cb_{bind(&Client::record_sample, this, _1, _2, _3, _4, _5, _6,
+                _7, _8)}
   , epollfd_{system_call(epoll_create1(0), "Client::Client: epoll_create1()")}
   , timerfd_{system_call(timerfd_create(CLOCK_MONOTONIC, O_NONBLOCK),
                          "Client::Client: timefd_create()")}
-  , results_{cfg_.samples}
+  , ring_{cfg_.io_backend == Config::EPOLL
+            ? nullptr
+            : new Uring(URING_ENTRIES,
+                        cfg_.io_backend == Config::URING_SQPOLL)}
+  , timer_gen_{0}
+  , timer_pending_{false}
+  , window_pending_{false}
+  , unflushed_{}
+  , results_{samples_, cfg_.hist_precision}
+  , windows_{}
+  , dump_{}
+  , journal_{}
   , sent_count_{0}
   , rcvd_count_{0}
   , measure_count_{0}
-  , pre_samples_{0}
-  , post_samples_{0}
-  , measure_samples_{0}
-  , total_samples_{0}
   , exp_start_time_{}
-  , deadlines_{}
-  , missed_threshold_{-cfg_.missed_window_us * 1000}
-  , missed_send_{0}
+  , schedule_{cfg_, req_s_, samples_, mt19937(rd_()),
+              shard_file(cfg_.replay_iatimes, cfg_.threads, shard_)}
+  , spin_slack_{chrono::microseconds(cfg_.spin_slack_us)}
+  , run_start_{}
+  , cpu_start_{0}
   , conns_{}
+  , conn_idx_{0}
+  , conn_ids_{0}
+  , done_{false}
+  , thinking_{}
+  , think_iat_{cfg_.arrival_dist, cfg_.arrival_shape}
+  , think_armed_{}
+  , measure_from_{}
+  , measure_to_{}
+  , stop_at_{}
 {
     epoll_watch(timerfd_, NULL, EPOLLIN);
+
+    // each shard has its own schedule, so record each to its own file
+    if (cfg_.save_iatimes != nullptr) {
+        schedule_.record(
+          shard_file(cfg_.save_iatimes, cfg_.threads, shard_));
+    }
+
+    if (schedule_.profile() != nullptr) {
+        results_.profile_segments(schedule_.profile()->segments().size());
+    }
+
+    if (cfg_.window_ms > 0) {
+        windows_.open(shard_file(cfg_.window_file, cfg_.threads, shard_),
+                      chrono::milliseconds(cfg_.window_ms), shard_);
+        if (cfg_.hist_file != nullptr) {
+            windows_.keep_history();
+        }
+    }
+
+    if (cfg_.dump_file != nullptr) {
+        dump_.open(shard_file(cfg_.dump_file, cfg_.threads, shard_));
+    }
+
+    if (cfg_.journal_file != nullptr) {
+        journal_.open(shard_file(cfg_.journal_file, cfg_.threads, shard_),
+                      shard_, req_s_);
+    }
 }
 
 /**
@@ -78,6 +197,16 @@ void Client::epoll_watch(int fd, void *data, uint32_t events)
  */
 void Client::timer_arm(duration deadline)
 {
+    if (ring_) {
+        // replace any pending timeout, telling them apart by generation
+        if (timer_pending_) {
+            ring_->cancel_timeout(Uring::cookie(timer_gen_, Uring::TIMER));
+        }
+        ring_->timeout(deadline, Uring::cookie(++timer_gen_, Uring::TIMER));
+        timer_pending_ = true;
+        return;
+    }
+
     itimerspec itval;
     itval.it_interval.tv_sec = 0;
     itval.it_interval.tv_nsec = 0;
@@ -92,6 +221,199 @@ void Client::timer_arm(duration deadline)
  * Run a client, generate load and measure repsonse times.
  */
 void Client::run(void)
+{
+    TscClock::calibrate(cfg_.use_tsc);
+    run_start_ = clock::now();
+    cpu_start_ = cpu_seconds();
+
+    if (cfg_.threads > 1) {
+        run_threads();
+    } else if (cfg_.slo_us > 0) {
+        search_capacity();
+    } else {
+        setup_experiment();
+        run_loop();
+    }
+
+    if (cfg_.hist_file != nullptr) {
+        save_histograms();
+    }
+    print_summary();
+}
+
+/**
+ * Run one event loop per thread, with ourselves as shard zero, merging the
+ * results of all shards into ours once every shard completes.
+ */
+void Client::run_threads(void)
+{
+    vector<unique_ptr<Client>> shards;
+    vector<thread> threads;
+    vector<exception_ptr> errors(cfg_.threads);
+
+    // connect before starting any thread so that all shards start generating
+    // load at (close to) the same time.
+    setup_experiment();
+    for (unsigned int i = 1; i < cfg_.threads; i++) {
+        shards.emplace_back(new Client(cfg_, i));
+        shards.back()->setup_experiment();
+    }
+
+    for (auto &s : shards) {
+        Client *c = s.get();
+        threads.emplace_back([c, &errors] {
+            try {
+                c->run_loop();
+            } catch (...) {
+                errors[c->shard_] = current_exception();
+            }
+        });
+        pin_thread(threads.back().native_handle(), c->shard_);
+    }
+
+    pin_thread(pthread_self(), shard_);
+    try {
+        run_loop();
+    } catch (...) {
+        errors[shard_] = current_exception();
+    }
+
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (auto &e : errors) {
+        if (e) {
+            rethrow_exception(e);
+        }
+    }
+
+    for (auto &c : shards) {
+        results_.merge(c->results_);
+        windows_.merge_history(c->windows_);
+        sent_count_ += c->sent_count_;
+    }
+}
+
+/**
+ * Search for the highest request rate at which the SLO percentile of the
+ * service time (or scheduled latency, with -o) stays under the SLO. The load
+ * is stepped over the same connections: the rate doubles from the configured
+ * one until a step fails, then bisects between the highest passing and lowest
+ * failing rates. Every step after the first only warms up briefly, since the
+ * connections and server are already warm. The results of the highest passing
+ * step are kept for the summary.
+ */
+void Client::search_capacity(void)
+{
+    double pass = 0, fail = 0; // highest passing & lowest failing rates
+    double rate = cfg_.req_s;
+    duration warmup = chrono::seconds(cfg_.warmup_seconds);
+    Results best{0};
+
+    if (not cfg_.machine_readable) {
+        printf(" search: target\t\thit\t\t%gth\tslo\n",
+               cfg_.slo_percentile);
+    }
+
+    setup_experiment();
+    for (unsigned int step = 0; step < SEARCH_MAX_STEPS; step++) {
+        if (step > 0) {
+            warmup = min(warmup, duration(chrono::seconds(
+                                   SEARCH_WARMUP_SECONDS)));
+            restart_experiment(rate, warmup);
+        }
+        run_loop();
+
+        Accum &lat =
+          cfg_.sched_latency ? results_.sched() : results_.service();
+        uint64_t pct = lat.percentile(cfg_.slo_percentile / 100);
+        bool ok = pct <= cfg_.slo_us and
+                  results_.reqps() >= rate * SEARCH_MIN_HIT;
+        if (not cfg_.machine_readable) {
+            printf("         %f\t%f\t%" PRIu64 "\t%s\n", rate,
+                   results_.reqps(), pct, ok ? "pass" : "fail");
+        }
+
+        if (ok) {
+            pass = rate;
+            best = results_;
+        } else {
+            fail = rate;
+        }
+
+        if (fail == 0) {
+            rate *= 2;
+        } else if (fail - pass <= fail * SEARCH_PRECISION) {
+            break;
+        } else {
+            rate = (pass + fail) / 2;
+        }
+    }
+
+    // summarise the highest passing step, or the last if none passed
+    if (pass > 0) {
+        results_ = best;
+        cfg_.req_s = pass;
+    } else {
+        cfg_.req_s = rate;
+        if (not cfg_.machine_readable) {
+            cout << "         no rate met the SLO" << endl;
+        }
+    }
+    if (not cfg_.machine_readable) {
+        cout << endl;
+    }
+}
+
+/**
+ * Start the experiment over at a new request rate, keeping the connections.
+ * Must only be called once all requests of the last run are answered.
+ * @req_s: the new request rate.
+ * @warmup: the new warm-up length.
+ */
+void Client::restart_experiment(double req_s, duration warmup)
+{
+    req_s_ = req_s;
+    schedule_.restart(req_s, warmup);
+    results_ = Results(samples_, cfg_.hist_precision);
+    if (journal_.is_open()) {
+        journal_.restart(req_s);
+    }
+    windows_.clear_history();
+    sent_count_ = 0;
+    rcvd_count_ = 0;
+    measure_count_ = 0;
+    done_ = false;
+}
+
+/**
+ * Run our event loop until all requests of our schedule are answered.
+ */
+void Client::run_loop(void)
+{
+    start_experiment();
+
+    if (ring_) {
+        run_ring();
+    } else {
+        run_epoll();
+    }
+
+    if (windows_.is_open()) {
+        windows_.finish(clock::now());
+    }
+    if (dump_.is_open()) {
+        dump_.flush();
+    }
+    if (journal_.is_open()) {
+        journal_.finish();
+    }
+}
+
+/**
+ * Run our event loop on epoll until done.
+ */
+void Client::run_epoll(void)
 {
     // Maximum outstanding epoll events supported
     constexpr size_t MAX_EVENTS = 4096;
@@ -101,17 +423,27 @@ void Client::run(void)
         epoll_timeout = 0;
     }
 
-    setup_experiment();
+    while (not done_) {
+        int nfds, timeout = epoll_timeout;
 
-    while (true) {
-        int nfds;
+        flush_sends();
+
+        // wake up to close the current window even if nothing happens
+        if (timeout < 0 and windows_.is_open() and
+            windows_.window_end() != time_point{}) {
+            auto left = windows_.window_end() - clock::now();
+            timeout = max(chrono::duration_cast<chrono::milliseconds>(
+                            left + chrono::milliseconds(1) -
+                            chrono::nanoseconds(1)).count(),
+                          int64_t(0));
+        }
 
         if (cfg_.use_epoll_spin) {
             nfds = system_call(epoll_spin(epollfd_, events, MAX_EVENTS,
-                               epoll_timeout), "Client::run: epoll_spin()");
+                               timeout), "Client::run: epoll_spin()");
         } else {
             nfds = system_call(epoll_wait(epollfd_, events, MAX_EVENTS,
-                               epoll_timeout), "Client::run: epoll_wait()");
+                               timeout), "Client::run: epoll_wait()");
         }
 
         for (int i = 0; i < nfds; i++) {
@@ -119,8 +451,9 @@ void Client::run(void)
             if (ev.data.ptr == nullptr) {
                 if (cfg_.use_busy_timer) {
                     throw runtime_error("timer event when using busy timer");
+                } else if (cfg_.outstanding == 0) {
+                    timer_handler();
                 }
-                timer_handler();
             } else {
                 Generator *g = reinterpret_cast<Generator *>(ev.data.ptr);
                 g->run_io(ev.events);
@@ -129,56 +462,107 @@ void Client::run(void)
 
         if (cfg_.use_busy_timer) {
             busy_timer();
+        } else if (cfg_.outstanding > 0) {
+            think_handler();
+        }
+        if (windows_.is_open()) {
+            windows_.tick(clock::now());
         }
     }
 }
 
-void Client::setup_experiment(void)
+/**
+ * Run our event loop on the io_uring until done.
+ */
+void Client::run_ring(void)
 {
-    setup_connections();
-    setup_deadlines();
-    exp_start_time_ = clock::now();
-    if (not cfg_.use_busy_timer) {
-        timer_handler();
+    constexpr unsigned int MAX_EVENTS = 4096;
+    vector<Uring::Event> events(MAX_EVENTS);
+
+    while (not done_) {
+        flush_sends();
+
+        // wake up to close the current window even if nothing happens
+        if (windows_.is_open() and not window_pending_ and
+            not cfg_.use_busy_timer and
+            windows_.window_end() != time_point{}) {
+            auto left = windows_.window_end() - clock::now();
+            ring_->timeout(max(duration(left), duration(1)),
+                           Uring::cookie(0, Uring::TIMER));
+            window_pending_ = true;
+        }
+
+        unsigned int n =
+          ring_->wait(events.data(), MAX_EVENTS, not cfg_.use_busy_timer);
+
+        for (unsigned int i = 0; i < n; i++) {
+            Uring::Event &ev = events[i];
+            uint64_t id = Uring::cookie_id(ev.cookie);
+            if (Uring::cookie_kind(ev.cookie) == Uring::TIMER) {
+                // only the latest timeout counts, and only if it expired;
+                // the window timeout (id 0) just wakes us up
+                if (id == 0) {
+                    window_pending_ = false;
+                    continue;
+                } else if (id != timer_gen_) {
+                    continue;
+                }
+                timer_pending_ = false;
+                if (ev.res == -ETIME and cfg_.outstanding == 0) {
+                    timer_handler();
+                }
+            } else if (void *owner = ring_->owner(id)) {
+                static_cast<Generator *>(owner)->complete_io(ev);
+            }
+        }
+
+        if (cfg_.use_busy_timer) {
+            busy_timer();
+        } else if (cfg_.outstanding > 0) {
+            think_handler();
+        }
+        if (windows_.is_open()) {
+            windows_.tick(clock::now());
+        }
     }
 }
 
-void Client::setup_deadlines(void)
-{
-    // Exponential distribution suggested by experimental evidence,
-    // c.f. Figure 11 in "Power Management of Online Data-Intensive Services"
-    std::exponential_distribution<double> d(1.0 / (NSEC / cfg_.req_s));
-    double accum = 0;
-    uint64_t pos = 0;
-    duration coolstart;
+void Client::setup_experiment(void) { setup_connections(); }
 
-    // generate warm-up samples
-    while (duration(uint64_t(ceil(accum))) <
-           std::chrono::seconds(cfg_.warmup_seconds)) {
-        accum += d(randgen_);
-        deadlines_.push_back(duration(uint64_t(ceil(accum))));
-        pos++;
+void Client::start_experiment(void)
+{
+    if (cfg_.outstanding > 0) {
+        // closed loop: phases are fixed in time, start every connection off
+        exp_start_time_ = clock::now();
+        if (windows_.is_open()) {
+            windows_.start(exp_start_time_);
+        }
+        measure_from_ =
+          exp_start_time_ + chrono::seconds(cfg_.warmup_seconds);
+        measure_to_ = measure_from_ + chrono::seconds(cfg_.measure_seconds);
+        stop_at_ = measure_to_ + chrono::seconds(cfg_.cooldown_seconds);
+        results_.start_measurements(measure_from_);
+        for (Generator *conn : conns_) {
+            for (uint64_t i = 0; i < cfg_.outstanding; i++) {
+                thinking_.emplace(exp_start_time_, conn);
+            }
+        }
+        think_handler();
+        return;
     }
-    pre_samples_ = pos;
 
-    // generate measurement samples
-    while (pos - pre_samples_ < cfg_.samples) {
-        accum += d(randgen_);
-        deadlines_.push_back(duration(uint64_t(ceil(accum))));
-        pos++;
+    if (schedule_.total_samples() == 0) {
+        done_ = true; // nothing to send
+        return;
     }
-    measure_samples_ = cfg_.samples;
 
-    // generate cool-down samples
-    coolstart = duration(uint64_t(ceil(accum)));
-    while (duration(uint64_t(ceil(accum))) - coolstart <
-           std::chrono::seconds(cfg_.cooldown_seconds)) {
-        accum += d(randgen_);
-        deadlines_.push_back(duration(uint64_t(ceil(accum))));
-        pos++;
+    exp_start_time_ = clock::now();
+    if (windows_.is_open()) {
+        windows_.start(exp_start_time_);
+    }
+    if (not cfg_.use_busy_timer) {
+        timer_handler();
     }
-    post_samples_ = pos - pre_samples_ - measure_samples_;
-    total_samples_ = pos;
 }
 
 /**
@@ -199,8 +583,17 @@ Generator *Client::new_connection(void)
         break;
     }
 
+    gen->set_id(conn_ids_++);
+    gen->batch_timestamps(cfg_.batch_ts);
+    if (cfg_.cork_tx) {
+        gen->cork(&unflushed_);
+    }
     gen->connect(cfg_.addr, cfg_.port);
-    epoll_watch(gen->fd(), gen, EPOLLIN | EPOLLOUT);
+    if (ring_) {
+        gen->use_ring(ring_.get());
+    } else {
+        epoll_watch(gen->fd(), gen, EPOLLIN | EPOLLOUT);
+    }
     return gen;
 }
 
@@ -210,7 +603,7 @@ void Client::setup_connections(void)
         return;
     }
 
-    for (size_t i = 0; i < cfg_.conn_cnt; i++) {
+    for (size_t i = 0; i < conn_cnt_; i++) {
         conns_.push_back(new_connection());
     }
 }
@@ -222,8 +615,7 @@ Generator *Client::get_connection(void)
         return new_connection();
     } else if (cfg_.conn_mode == cfg_.ROUND_ROBIN) {
         // round-robin through a pool of established connections
-        static int idx = 0;
-        Generator *gen = conns_[idx++ % conns_.size()];
+        Generator *gen = conns_[conn_idx_++ % conns_.size()];
         gen->get();
         return gen;
     } else {
@@ -236,26 +628,28 @@ Generator *Client::get_connection(void)
 
 void Client::timer_handler(void)
 {
-    time_point now_time = clock::now();
-    duration now_relative =
-      chrono::duration_cast<duration>(now_time - exp_start_time_);
+    if (sent_count_ >= schedule_.total_samples()) {
+        return;
+    }
 
-    uint64_t looped = 0;
-    duration sleep_duration;
     while (true) {
-        sleep_duration = deadlines_[sent_count_] - now_relative;
-        if (sleep_duration > duration(0)) {
-            timer_arm(sleep_duration);
+        // re-read the clock for each send, so the lateness of a backlog of
+        // overdue sends includes the time taken by those before them
+        duration now_relative =
+          chrono::duration_cast<duration>(clock::now() - exp_start_time_);
+        duration deadline = schedule_.deadline(sent_count_);
+        duration sleep_duration = deadline - now_relative;
+        if (sleep_duration > spin_slack_) {
+            // hybrid timer: wake up early by the slack and spin the rest
+            timer_arm(sleep_duration - spin_slack_);
             return;
-        } else if (looped > 0 and sleep_duration < missed_threshold_) {
-            // Missed timer! Client appears to be overloaded...
-            // TODO: Best way to detect and record?
-            missed_send_++;
+        } else if (sleep_duration > duration(0)) {
+            now_relative = spin_until(deadline);
+            sleep_duration = deadline - now_relative;
         }
-        looped++;
-        send_request();
+        send_request(-sleep_duration);
         sent_count_++;
-        if (sent_count_ >= total_samples_) {
+        if (sent_count_ >= schedule_.total_samples()) {
             return;
         }
     }
@@ -263,65 +657,212 @@ void Client::timer_handler(void)
 
 void Client::busy_timer(void)
 {
-    time_point now = clock::now();
-    duration d = deadlines_[sent_count_] + exp_start_time_ - now;
-
-    while (d <= duration(0) and sent_count_ < total_samples_) {
-        if (d < missed_threshold_) {
-            missed_send_++;
+    while (sent_count_ < schedule_.total_samples()) {
+        duration d =
+          schedule_.deadline(sent_count_) + exp_start_time_ - clock::now();
+        if (d > duration(0)) {
+            return;
         }
-        send_request();
+        send_request(-d);
         sent_count_++;
-        d = deadlines_[sent_count_] + exp_start_time_ - now;
     }
 }
 
-void Client::send_request(void)
+/**
+ * Transmit the sends corked connections held back during this batch (of
+ * events and timers), one write per connection for all its requests.
+ */
+void Client::flush_sends(void)
+{
+    for (Sock *s : unflushed_) {
+        s->flush();
+    }
+    unflushed_.clear();
+}
+
+/**
+ * Spin until a deadline is reached.
+ * @deadline: the deadline, relative to the start of the experiment.
+ * @return: the time, relative to the start of the experiment, on return.
+ */
+Client::duration Client::spin_until(duration deadline)
+{
+    // get what's queued going before we spin
+    flush_sends();
+    if (ring_) {
+        ring_->submit();
+    }
+
+    duration now;
+    do {
+        now = chrono::duration_cast<duration>(clock::now() - exp_start_time_);
+    } while (now < deadline);
+    return now;
+}
+
+/**
+ * Send the next request of the schedule.
+ * @lateness: how far behind its deadline the request is being sent.
+ */
+void Client::send_request(duration lateness)
 {
-    if (sent_count_ == pre_samples_) {
+    if (sent_count_ == schedule_.pre_samples()) {
         results_.start_measurements();
     }
 
-    // in measure phase? (not warm up or down)
-    bool measure = sent_count_ >= pre_samples_ and
-                   sent_count_ < pre_samples_ + measure_samples_;
+    // in measure phase? (not warm up or down) - the schedule is always
+    // generated ahead of us, so the phase of sent_count_ is known.
+    bool measure = sent_count_ >= schedule_.pre_samples() and
+                   sent_count_ - schedule_.pre_samples() <
+                     schedule_.measure_samples();
 
     // gen is reference counted (get/put, starts at 1) and we'll deallocate it
     // in `record_sample`.
     Generator *gen = get_connection();
-    uint64_t bytes = gen->send_request(measure, gen_cb_);
+    duration due = schedule_.deadline(sent_count_);
+    uint64_t bytes =
+      gen->send_request(measure, exp_start_time_ + due, gen_cb_);
     if (measure) {
+        size_t second = (due - schedule_.measure_start()) / chrono::seconds(1);
         results_.sent_bytes(bytes);
+        results_.add_lateness(second, lateness.count());
+        if (cfg_.conn_mode != Config::PER_REQUEST) {
+            results_.add_conn_send(gen->id(), gen->outstanding());
+        }
     }
 }
 
 /**
  * Record a latency sample.
  */
-void Client::record_sample(Generator *conn, uint64_t queue_us,
-                           uint64_t service_us, uint64_t wait_us,
-                           uint64_t bytes, bool measure)
+void Client::record_sample(Generator *conn, const Generator::Stamps &ts,
+                           uint64_t queue_us, uint64_t service_us,
+                           uint64_t sched_us, uint64_t wait_us, uint64_t bytes,
+                           bool measure)
 {
+    if (windows_.is_open()) {
+        windows_.add_sample(ts.recv, queue_us, service_us, wait_us);
+    }
+    if (dump_.is_open()) {
+        dump_.write({since_start(ts.deadline), since_start(ts.start),
+                     since_start(ts.sent), since_start(ts.recv), conn->id(),
+                     ts.op, measure});
+    }
+
     if (measure) {
         measure_count_++;
         results_.add_sample(queue_us, service_us, wait_us, bytes);
+        if (journal_.is_open()) {
+            journal_.append(since_start(ts.recv), queue_us, service_us,
+                            wait_us, sched_us);
+        }
+        if (cfg_.sched_latency) {
+            results_.add_sched(sched_us);
+        }
+        if (schedule_.profile() != nullptr) {
+            record_segment(ts.deadline, service_us);
+        }
+        if (cfg_.protocol == Config::MEMCACHE) {
+            results_.add_op_sample(ts.op, queue_us, service_us, ts.tx_bytes,
+                                   bytes);
+        }
+        if (cfg_.conn_mode != Config::PER_REQUEST) {
+            results_.add_conn_sample(conn->id(), service_us);
+        }
 
         // final measurement app-packet - record experiment time
-        if (measure_count_ == measure_samples_) {
+        if (cfg_.outstanding == 0 and
+            measure_count_ == schedule_.measure_samples()) {
             results_.end_measurements();
         }
     }
 
+    conn->answered();
     conn->put(); // request finished
 
     rcvd_count_++;
-    if (rcvd_count_ >= total_samples_) {
-        print_summary();
-        record_iatimes();
-        exit(EXIT_SUCCESS);
+    if (cfg_.outstanding > 0) {
+        think(conn);
+    } else if (rcvd_count_ >= schedule_.total_samples()) {
+        done_ = true;
+    }
+}
+
+/**
+ * Closed loop: send a connection's next request once it has thought for a
+ * while, or finish once the experiment is over and all requests answered.
+ * Sends are deferred to `think_handler` even without think time, so that we
+ * never send from within a connection's receive path.
+ */
+void Client::think(Generator *conn)
+{
+    time_point now = clock::now();
+    if (now < stop_at_) {
+        duration t{uint64_t(cfg_.think_us * 1000 * think_iat_(randgen_))};
+        thinking_.emplace(now + t, conn);
+    } else if (rcvd_count_ == sent_count_) {
+        results_.end_measurements(measure_to_);
+        done_ = true;
+    }
+}
+
+/**
+ * Closed loop: send the requests of all connections done thinking, and arm
+ * the timer for the next to be.
+ */
+void Client::think_handler(void)
+{
+    time_point now = clock::now();
+    while (not thinking_.empty() and thinking_.top().first <= now) {
+        think_entry next = thinking_.top();
+        thinking_.pop();
+        if (next.first < stop_at_) {
+            send_closed(next.second, next.first);
+        }
+    }
+
+    if (thinking_.empty()) {
+        if (now >= stop_at_ and rcvd_count_ == sent_count_ and not done_) {
+            results_.end_measurements(measure_to_);
+            done_ = true;
+        }
+    } else if (thinking_.top().first != think_armed_) {
+        think_armed_ = thinking_.top().first;
+        timer_arm(max(think_armed_ - now, duration(1)));
+    }
+}
+
+/**
+ * Closed loop: send a connection's next request.
+ * @conn: the connection to send on.
+ * @due: when the request was due to be sent, i.e., its think time expired.
+ */
+void Client::send_closed(Generator *conn, time_point due)
+{
+    bool measure = due >= measure_from_ and due < measure_to_;
+    conn->get(); // put in `record_sample`
+    uint64_t bytes = conn->send_request(measure, due, gen_cb_);
+    sent_count_++;
+    if (measure) {
+        size_t second = (due - measure_from_) / chrono::seconds(1);
+        results_.sent_bytes(bytes);
+        results_.add_lateness(second, (clock::now() - due).count());
+        results_.add_conn_send(conn->id(), conn->outstanding());
     }
 }
 
+/**
+ * Attribute a latency sample to the load profile segment its request was
+ * scheduled in.
+ */
+void Client::record_segment(time_point deadline, uint64_t service_us)
+{
+    duration gen = deadline - exp_start_time_ - schedule_.measure_start();
+    const LoadProfile *profile = schedule_.profile();
+    results_.add_segment_sample(profile->segment(gen.count() / NSEC),
+                                service_us);
+}
+
 /**
  * Print summary of current results.
  *
@@ -335,35 +876,48 @@ void Client::print_summary(void)
         return;
     }
 
+    double target = cfg_.req_s;
+    if (schedule_.profile() != nullptr) {
+        target = schedule_.profile()->mean_rate();
+    }
+
     cout << "#reqs/s: hit\t\ttarget" << endl;
-    printf("         %f\t%f\t\n", results_.reqps(), cfg_.req_s);
+    if (cfg_.outstanding > 0) {
+        // a closed loop has no target, only a concurrency
+        printf("         %f\t(closed: %" PRIu64 " x %" PRIu64 " conns)\n",
+               results_.reqps(), cfg_.outstanding, cfg_.conn_cnt);
+    } else {
+        printf("         %f\t%f\t\n", results_.reqps(), target);
+    }
     cout << endl;
 
     cout << "service: min\tavg\t\tstd\t\t99th\t99.9th\tmax" << endl;
-    printf("         %" PRIu64 "\t%f\t%f\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
-           "\n",
-           results_.service().min(), results_.service().mean(),
-           results_.service().stddev(), results_.service().percentile(0.99),
-           results_.service().percentile(0.999), results_.service().max());
+    print_stats(results_.service());
     cout << endl;
 
+    if (cfg_.sched_latency) {
+        cout << "  sched: min\tavg\t\tstd\t\t99th\t99.9th\tmax" << endl;
+        print_stats(results_.sched());
+        cout << endl;
+    }
+
     cout << " buffer: min\tavg\t\tstd\t\t99th\t99.9th\tmax" << endl;
-    printf("         %" PRIu64 "\t%f\t%f\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
-           "\n",
-           results_.queue().min(), results_.queue().mean(),
-           results_.queue().stddev(), results_.queue().percentile(0.99),
-           results_.queue().percentile(0.999), results_.queue().max());
+    print_stats(results_.queue());
 
     if (cfg_.protocol == Config::SYNTHETIC) {
         cout << endl;
         cout << "   wait: min\tavg\t\tstd\t\t99th\t99.9th\tmax" << endl;
-        printf("         %" PRIu64 "\t%f\t%f\t%" PRIu64 "\t%" PRIu64
-               "\t%" PRIu64 "\n",
-               results_.wait().min(), results_.wait().mean(),
-               results_.wait().stddev(), results_.wait().percentile(0.99),
-               results_.wait().percentile(0.999), results_.wait().max());
+        print_stats(results_.wait());
     }
 
+    cout << endl;
+    cout << "   late: min\tavg\t\tstd\t\t99th\t99.9th\tmax (ns)" << endl;
+    printf("         %" PRIu64 "\t%f\t%f\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+           "\n",
+           results_.lateness().min(), results_.lateness().mean(),
+           results_.lateness().stddev(), results_.lateness().percentile(0.99),
+           results_.lateness().percentile(0.999), results_.lateness().max());
+
     constexpr uint64_t MB = 1024 * 1024;
     double time_s = results_.running_time() / NSEC;
     double rx_mbs = double(results_.rx_bytes()) / MB;
@@ -372,26 +926,180 @@ void Client::print_summary(void)
     printf("\n");
     printf("RX: %.2f MB/s (%.2f MB)\n", rx_mbs / time_s, rx_mbs);
     printf("TX: %.2f MB/s (%.2f MB)\n", tx_mbs / time_s, tx_mbs);
-    printf("Missed sends: %lu / %lu (%.4f%%)\n", missed_send_, sent_count_,
-           double(missed_send_) / sent_count_ * 100);
+    uint64_t missed = results_.lateness().count_above(
+      cfg_.missed_window_us * 1000);
+    printf("Missed sends: %lu / %lu (%.4f%%)\n", missed,
+           results_.lateness().size(),
+           double(missed) / results_.lateness().size() * 100);
+
+    double wall_s =
+      chrono::duration<double>(clock::now() - run_start_).count();
+    printf("CPU: %.2f%% of a core\n",
+           (cpu_seconds() - cpu_start_) / wall_s * 100);
+    if (TscClock::tsc_enabled()) {
+        printf("Clock: TSC at %.3f GHz (calibration error %.2f ppm)\n",
+               TscClock::tsc_ghz(), TscClock::calibration_error());
+    } else {
+        printf("Clock: CLOCK_MONOTONIC\n");
+    }
+
+    print_lateness();
+    if (cfg_.protocol == Config::MEMCACHE) {
+        print_ops();
+    }
+    if (results_.conns().size() > 1) {
+        print_conns();
+    }
+    if (schedule_.profile() != nullptr) {
+        print_profile();
+    }
 }
 
 /**
- * Record our deadline schedule to a file for offline evaluation.
+ * Print send lateness broken down by second of the measurement phase.
  */
-void Client::record_iatimes(void)
+void Client::print_lateness(void)
 {
-    if (cfg_.save_iatimes != nullptr) {
-        duration last{0};
-        ofstream f(cfg_.save_iatimes);
-        for (auto t : deadlines_) {
-            if (last == duration(0)) {
-                last = t;
-            } else {
-                f << (t - last).count() << "\n";
-                last = t;
-            }
+    uint64_t window = cfg_.missed_window_us * 1000;
+    auto &seconds = results_.late_seconds();
+
+    cout << endl;
+    cout << " late/s: sec\tsends\tmissed\tavg\t\t99th\t99.9th\tmax (ns)"
+         << endl;
+    for (size_t i = 0; i < seconds.size(); i++) {
+        Histogram &h = seconds[i];
+        if (h.size() == 0) {
+            printf("         %zu\t0\t0\t-\t\t-\t-\t-\n", i);
+            continue;
+        }
+        printf("         %zu\t%" PRIu64 "\t%" PRIu64 "\t%f\t%" PRIu64
+               "\t%" PRIu64 "\t%" PRIu64 "\n",
+               i, h.size(), h.count_above(window), h.mean(),
+               h.percentile(0.99), h.percentile(0.999), h.max());
+    }
+}
+
+/**
+ * Save the latency histograms of the run (and of each window, with -R) to be
+ * merged with those of other runs.
+ */
+void Client::save_histograms(void)
+{
+    vector<HistEntry> entries;
+    auto add = [&entries](const string &metric, const Histogram &h) {
+        entries.push_back({metric, 0, 0, h});
+    };
+
+    add("service", results_.service().histogram(HIST_SAVE_PRECISION));
+    add("buffer", results_.queue().histogram(HIST_SAVE_PRECISION));
+    if (cfg_.protocol == Config::SYNTHETIC) {
+        add("wait", results_.wait().histogram(HIST_SAVE_PRECISION));
+    }
+    if (cfg_.sched_latency) {
+        add("sched", results_.sched().histogram(HIST_SAVE_PRECISION));
+    }
+    add("late_ns", results_.lateness());
+
+    auto &ops = results_.ops();
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (ops[i].service.size() > 0) {
+            add(string("service.") + op_name(i),
+                ops[i].service.histogram(HIST_SAVE_PRECISION));
+        }
+    }
+
+    auto &windows = windows_.history();
+    entries.insert(entries.end(), windows.begin(), windows.end());
+    write_histograms(cfg_.hist_file, entries);
+}
+
+/**
+ * Print throughput and latency broken down by memcache operation.
+ */
+void Client::print_ops(void)
+{
+    constexpr uint64_t MB = 1024 * 1024;
+    double time_s = results_.running_time() / NSEC;
+    auto &ops = results_.ops();
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        Results::OpResults &op = ops[i];
+        if (op.service.size() == 0) {
+            continue;
+        }
+
+        cout << endl;
+        printf("%7s: reqs/s\t\tRX MB/s\tTX MB/s\n", op_name(i));
+        printf("         %f\t%.2f\t%.2f\n", op.service.size() / time_s,
+               double(op.rx_bytes) / MB / time_s,
+               double(op.tx_bytes) / MB / time_s);
+        cout << "service: min\tavg\t\tstd\t\t99th\t99.9th\tmax" << endl;
+        print_stats(op.service);
+        cout << " buffer: min\tavg\t\tstd\t\t99th\t99.9th\tmax" << endl;
+        print_stats(op.queue);
+    }
+}
+
+/**
+ * Print how throughput, service time and depth (requests outstanding when
+ * sending) are distributed across connections, to show any imbalance.
+ */
+void Client::print_conns(void)
+{
+    auto &conns = results_.conns();
+    double time_s = results_.running_time() / NSEC;
+    size_t n = conns.size();
+    vector<double> v(n);
+
+    cout << endl;
+    printf("  conns: %zu\tmin\t\t50th\t\tmax\t\t(conn)\n", n);
+    auto row = [&](const char *name, function<double(size_t)> stat) {
+        for (size_t i = 0; i < n; i++) {
+            v[i] = stat(i);
+        }
+        size_t worst = max_element(v.begin(), v.end()) - v.begin();
+        double top = v[worst];
+        nth_element(v.begin(), v.begin() + n / 2, v.end());
+        double median = v[n / 2];
+        printf("%7s:\t%f\t%f\t%f\t%zu\n", name,
+               *min_element(v.begin(), v.end()), median, top, worst);
+    };
+
+    row("reqs/s", [&](size_t i) { return conns[i].service.size() / time_s; });
+    row("avg", [&](size_t i) { return conns[i].service.mean(); });
+    row("99th", [&](size_t i) {
+        return double(conns[i].service.percentile(0.99));
+    });
+    row("max", [&](size_t i) { return double(conns[i].service.max()); });
+    row("depth", [&](size_t i) {
+        return conns[i].sends ? double(conns[i].depth_sum) / conns[i].sends
+                              : 0;
+    });
+    row("max dep", [&](size_t i) { return double(conns[i].depth_max); });
+}
+
+/**
+ * Print service times broken down by load profile segment.
+ */
+void Client::print_profile(void)
+{
+    auto &segments = schedule_.profile()->segments();
+
+    cout << endl;
+    cout << "profile: start\tsecs\ttarget\t\thit\t\tavg\t\t99th\t99.9th"
+            "\tmax"
+         << endl;
+    for (size_t i = 0; i < segments.size(); i++) {
+        auto &seg = segments[i];
+        Accum &acc = results_.segment(i);
+        printf("         %.2f\t%.2f\t%f\t%f\t", seg.start, seg.secs,
+               seg.requests() / seg.secs, acc.size() / seg.secs);
+        if (acc.size() == 0) {
+            printf("-\t\t-\t-\t-\n");
+            continue;
         }
-        f.close();
+        auto pct = acc.percentiles({0.99, 0.999});
+        printf("%f\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", acc.mean(),
+               pct[0], pct[1], acc.max());
     }
 }
@@ -2,25 +2,49 @@
 #define MUTATED_CLIENT_HH
 
 #include <chrono>
+#include <functional>
 #include <memory>
+#include <queue>
+#include <utility>
 #include <vector>
 
+#include "clock.hh"
 #include "generator.hh"
+#include "interarrival.hh"
+#include "journal.hh"
 #include "opts.hh"
 #include "results.hh"
+#include "samples.hh"
+#include "schedule.hh"
+#include "timeseries.hh"
+#include "uring.hh"
 
 /**
  * Mutated load generator.
+ *
+ * A client is a single event loop (epoll + timerfd, or an io_uring and its
+ * timeouts) driving its own set of connections to the server along its own
+ * request schedule. When configured with multiple threads, the client
+ * running `run()` acts as shard zero: it creates a client for each other
+ * thread, giving each an equal share of the request rate, samples and
+ * connections, and merges their results once all have finished. Shards share
+ * nothing while generating load.
  */
 class Client
 {
   private:
-    using clock = std::chrono::steady_clock;
+    using clock = Clock;
     using time_point = clock::time_point;
     using duration = std::chrono::nanoseconds;
 
     Config cfg_;
 
+    /* This event loop's share of the experiment */
+    unsigned int shard_;
+    double req_s_;
+    uint64_t samples_;
+    uint64_t conn_cnt_;
+
     std::random_device rd_;
     std::mt19937 randgen_;
     std::uniform_int_distribution<int> conn_dist_;
@@ -29,33 +53,84 @@ class Client
     unsigned int epollfd_;
     unsigned int timerfd_;
 
+    /* io_uring backend (or null), and its timer: the generation of the last
+     * timeout armed, and whether it may yet complete (also for the timeout
+     * that closes -R windows) */
+    std::unique_ptr<Uring> ring_;
+    uint64_t timer_gen_;
+    bool timer_pending_;
+    bool window_pending_;
+
+    /* Corked (-K) connections with sends held back in this batch */
+    std::vector<Sock *> unflushed_;
+
     Results results_;
+    TimeSeries windows_; /* per-window results, streamed during the run */
+    SampleWriter dump_;  /* raw samples, written as they arrive */
+    Journal journal_;    /* measured samples, kept safe from crashes */
 
     uint64_t sent_count_, rcvd_count_, measure_count_;
-    uint64_t pre_samples_, post_samples_, measure_samples_, total_samples_;
 
     time_point exp_start_time_;
-    std::vector<duration> deadlines_;
-    duration missed_threshold_;
-    uint64_t missed_send_;
+    Schedule schedule_;
+    duration spin_slack_;
+
+    time_point run_start_; /* wall and cpu time at start, for cpu usage */
+    double cpu_start_;
 
     std::vector<Generator *> conns_;
+    std::size_t conn_idx_;
+    uint64_t conn_ids_; /* connections opened so far */
+    bool done_;
+
+    /* Closed-loop mode: connections waiting out their think time to send */
+    using think_entry = std::pair<time_point, Generator *>;
+    std::priority_queue<think_entry, std::vector<think_entry>,
+                        std::greater<think_entry>>
+      thinking_;
+    InterArrival think_iat_;
+    time_point think_armed_;
+    time_point measure_from_, measure_to_, stop_at_;
 
     Generator *new_connection(void);
     void setup_connections(void);
     Generator *get_connection(void);
-    void send_request(void);
+    void send_request(duration lateness);
+    void send_closed(Generator *conn, time_point due);
+    void think(Generator *conn);
+    void think_handler(void);
+    void record_segment(time_point deadline, uint64_t service_us);
     void epoll_watch(int fd, void *data, uint32_t events);
     void timer_arm(duration deadline);
     void timer_handler(void);
     void busy_timer(void);
-    void setup_deadlines(void);
+    void flush_sends(void);
+    duration spin_until(duration deadline);
+
+    /* Nanoseconds from the start of the experiment to a time */
+    uint64_t since_start(time_point t) const noexcept
+    {
+        return std::chrono::duration_cast<duration>(t - exp_start_time_)
+          .count();
+    }
+
     void setup_experiment(void);
+    void start_experiment(void);
+    void run_loop(void);
+    void run_epoll(void);
+    void run_ring(void);
+    void run_threads(void);
+    void restart_experiment(double req_s, duration warmup);
+    void search_capacity(void);
+    void save_histograms(void);
     void print_summary(void);
-    void record_iatimes(void);
+    void print_profile(void);
+    void print_lateness(void);
+    void print_ops(void);
+    void print_conns(void);
 
   public:
-    explicit Client(Config c);
+    explicit Client(Config c, unsigned int shard = 0);
     ~Client(void) noexcept;
 
     /* No copy or move. */
@@ -68,8 +143,10 @@ class Client
     void run(void);
 
     /* Record a latency sample. */
-    void record_sample(Generator *, uint64_t queue_us, uint64_t service_us,
-                       uint64_t wait_us, uint64_t bytes, bool should_measure);
+    void record_sample(Generator *, const Generator::Stamps &ts,
+                       uint64_t queue_us, uint64_t service_us,
+                       uint64_t sched_us, uint64_t wait_us, uint64_t bytes,
+                       bool should_measure);
 };
 
 #endif /* MUTATED_CLIENT_HH */
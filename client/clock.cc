@@ -0,0 +1,88 @@
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "clock.hh"
+
+using namespace std;
+
+/* How long to calibrate the TSC over, and then to check it over, and how many
+ * times to try sampling both clocks together each time */
+static constexpr chrono::milliseconds CALIBRATE_PERIOD{50};
+static constexpr unsigned int CALIBRATE_TRIES = 16;
+
+bool TscClock::use_tsc_ = false;
+uint64_t TscClock::base_tsc_ = 0;
+uint64_t TscClock::base_ns_ = 0;
+uint64_t TscClock::mult_ = uint64_t(1) << TscClock::SHIFT;
+double TscClock::error_ppm_ = 0;
+
+bool TscClock::tsc_invariant(void) noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    return edx & (1 << 8);
+#else
+    return false;
+#endif
+}
+
+/**
+ * Calibrate the TSC against CLOCK_MONOTONIC, then measure how far the two
+ * drift apart over the same period again to report the calibration error.
+ * Falls back to CLOCK_MONOTONIC if the TSC isn't invariant.
+ * @use_tsc: whether to use the TSC at all.
+ */
+void TscClock::calibrate(bool use_tsc)
+{
+#ifdef MUTATED_NO_TSC
+    use_tsc = false;
+#endif
+    use_tsc_ = false;
+    error_ppm_ = 0;
+    if (not use_tsc or not tsc_invariant()) {
+        return;
+    }
+
+    // sample both clocks at (close to) the same instant, taking the TSC on
+    // both sides of clock_gettime() and keeping the tightest of a few tries
+    auto sample = [](uint64_t &ticks, uint64_t &ns) {
+        uint64_t best = UINT64_MAX;
+        for (unsigned int i = 0; i < CALIBRATE_TRIES; i++) {
+            uint64_t t0 = tsc();
+            uint64_t n = monotonic_ns();
+            uint64_t t1 = tsc();
+            if (t1 - t0 < best) {
+                best = t1 - t0;
+                ticks = t0 + (t1 - t0) / 2;
+                ns = n;
+            }
+        }
+    };
+
+    uint64_t tsc0 = 0, ns0 = 0, tsc1 = 0, ns1 = 0;
+    sample(tsc0, ns0);
+    this_thread::sleep_for(CALIBRATE_PERIOD);
+    sample(tsc1, ns1);
+    if (tsc1 <= tsc0) {
+        return;
+    }
+
+    base_tsc_ = tsc1;
+    base_ns_ = ns1;
+    mult_ = ((ns1 - ns0) << SHIFT) / (tsc1 - tsc0);
+    use_tsc_ = true;
+
+    this_thread::sleep_for(CALIBRATE_PERIOD);
+    uint64_t ticks = 0, ns = 0;
+    sample(ticks, ns);
+    __extension__ using uint128 = unsigned __int128;
+    uint64_t tsc_ns =
+      base_ns_ + ((uint128(ticks - base_tsc_) * mult_) >> SHIFT);
+    error_ppm_ = (double(tsc_ns) - double(ns)) / (ns - base_ns_) * 1e6;
+}
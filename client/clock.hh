@@ -0,0 +1,98 @@
+#ifndef MUTATED_CLOCK_HH
+#define MUTATED_CLOCK_HH
+
+/**
+ * clock.hh - the clock used to timestamp requests and schedule sends.
+ *
+ * Reading steady_clock costs a vDSO call, and we read it several times per
+ * request. Where the CPU has an invariant TSC we instead read the TSC directly
+ * and scale it to nanoseconds with a multiply and shift, calibrated against
+ * CLOCK_MONOTONIC at startup. Building with MUTATED_NO_TSC (configure
+ * --disable-tsc) uses steady_clock throughout instead.
+ */
+
+#include <chrono>
+#include <cstdint>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * A steady clock backed by the TSC when available and enabled, falling back
+ * to CLOCK_MONOTONIC otherwise. Must be calibrated before use, and before any
+ * threads are started.
+ */
+class TscClock
+{
+  public:
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<TscClock>;
+    static constexpr bool is_steady = true;
+
+  private:
+    static constexpr unsigned int SHIFT = 32;
+
+    static bool use_tsc_;
+    static uint64_t base_tsc_; /* TSC at calibration */
+    static uint64_t base_ns_;  /* CLOCK_MONOTONIC at calibration */
+    static uint64_t mult_;     /* ns per tick, fixed point with SHIFT bits */
+    static double error_ppm_;  /* drift from CLOCK_MONOTONIC when checked */
+
+    static uint64_t monotonic_ns(void) noexcept
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static uint64_t tsc(void) noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+  public:
+    /* Calibrate the TSC against CLOCK_MONOTONIC, or disable it. */
+    static void calibrate(bool use_tsc);
+
+    /* Is the CPU's TSC invariant (constant rate, runs in all C-states)? */
+    static bool tsc_invariant(void) noexcept;
+
+    /* Is the TSC being used? */
+    static bool tsc_enabled(void) noexcept { return use_tsc_; }
+
+    /* TSC frequency (GHz) */
+    static double tsc_ghz(void) noexcept
+    {
+        return double(uint64_t(1) << SHIFT) / mult_;
+    }
+
+    /* Drift from CLOCK_MONOTONIC measured after calibration (ppm) */
+    static double calibration_error(void) noexcept { return error_ppm_; }
+
+    static time_point now(void) noexcept
+    {
+        if (not use_tsc_) {
+            return time_point(duration(monotonic_ns()));
+        }
+        __extension__ using uint128 = unsigned __int128;
+        uint128 ticks = tsc() - base_tsc_;
+        return time_point(duration(base_ns_ + ((ticks * mult_) >> SHIFT)));
+    }
+};
+
+#ifdef MUTATED_NO_TSC
+using Clock = std::chrono::steady_clock;
+#else
+using Clock = TscClock;
+#endif
+
+#endif /* MUTATED_CLOCK_HH */
@@ -1,6 +1,7 @@
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 
 #include <arpa/inet.h>
@@ -22,11 +23,41 @@ using namespace std::placeholders;
 /* Size of fmt string for generating keys */
 static constexpr std::size_t KEYFMT_SIZE = 30;
 
-/* Key generation */
-static bool _kv_setup = false;
+/* Key generation, set up once for all connections and threads */
+static once_flag _kv_setup;
 static char _keyfmt[KEYFMT_SIZE];
 static char *_keys = nullptr;
 static char *_val = nullptr;
+static SharedBuf *_shared_val = nullptr; /* _val, for large values */
+
+/**
+ * Create all the keys and the value requests use upfront.
+ */
+static void setup_kv(const Config &cfg)
+{
+    // create the fmt string for creating keys (TODO: better way than this?)
+    // KEYFMT: <000000...N>
+    int n = snprintf(_keyfmt, KEYFMT_SIZE, "%%0%" PRIu64 "%s", cfg.keysize,
+                     PRIu64);
+    if (uint64_t(n) >= KEYFMT_SIZE) {
+        throw runtime_error(
+          "Memcache::Memcache: fmt buffer for printing keys too small");
+    }
+
+    // create keys
+    _keys = new char[cfg.records * (cfg.keysize + 1)];
+    for (size_t i = 1; i <= cfg.records; i++) {
+        char *buf = &_keys[(i - 1) * (cfg.keysize + 1)];
+        snprintf(buf, cfg.keysize + 1, _keyfmt, i);
+    }
+
+    // create value(s)
+    _val = new char[cfg.valsize];
+    memset(_val, 'a', cfg.valsize);
+    if (cfg.valsize >= SHARED_VALUE_MIN) {
+        _shared_val = new SharedBuf(_val, cfg.valsize);
+    }
+}
 
 /**
  * Construct.
@@ -35,38 +66,14 @@ Memcache::Memcache(const Config &cfg, std::mt19937 &&rand)
   : cfg_{cfg},
     rand_{move(rand)},
     setget_{0, 1.0},
-    rcb_{bind(&Memcache::recv_response, this, _1, _2, _3, _4, _5, _6, _7)},
+    rcb_{bind(&Memcache::recv_response, this, _1, _2, _3, _4, _5)},
     tcb_{bind(&Memcache::sent_request, this, _1, _2, _3)},
     requests_{},
     seqid_{rand_()} // start from random sequence id
 {
-    UNUSED(cfg_);
-
-    // create all needed requests upfront
-    if (not _kv_setup) {
-        _kv_setup = true;
-
-        // create the fmt string for creating keys (TODO: better way than
-        // this?)
-        // KEYFMT: <000000...N>
-        int n = snprintf(_keyfmt, KEYFMT_SIZE, "%%0%" PRIu64 "%s",
-                         cfg_.keysize, PRIu64);
-        if (uint64_t(n) >= KEYFMT_SIZE) {
-            throw runtime_error(
-              "Memcache::Memcache: fmt buffer for printing keys too small");
-        }
-
-        // create keys
-        _keys = new char[cfg_.records * (cfg_.keysize + 1)];
-        for (size_t i = 1; i <= cfg_.records; i++) {
-            char *buf = &_keys[(i - 1) * (cfg_.keysize + 1)];
-            snprintf(buf, cfg_.keysize + 1, _keyfmt, i);
-        }
-
-        // create value(s)
-        _val = new char[cfg_.valsize];
-        memset(_val, 'a', cfg_.valsize);
-    }
+    // connections may be created on several threads at once (-t with
+    // per-request connections)
+    call_once(_kv_setup, setup_kv, cref(cfg_));
 }
 
 MemcCmd Memcache::choose_cmd(void)
@@ -94,7 +101,8 @@ char *Memcache::choose_val(uint64_t id, uint32_t &n)
 /**
  * Generate and send a new request.
  */
-uint64_t Memcache::_send_request(bool measure, RequestCB cb)
+uint64_t Memcache::_send_request(bool measure, time_point deadline,
+                                 RequestCB cb)
 {
     uint64_t id = seqid_++;
     uint16_t keylen;
@@ -116,15 +124,20 @@ uint64_t Memcache::_send_request(bool measure, RequestCB cb)
         sock_.write_emplace<MemcExtrasSet>();
         sock_.write(key, keylen);
 
-        // just write random bytes for the value
-        size_t vn = cfg_.valsize;
-        sock_.write_prepare(vn);
-        sock_.write_commit(cfg_.valsize);
+        // large values are sent from shared memory without copying, others
+        // are just whatever bytes are in the buffer
+        if (_shared_val != nullptr) {
+            sock_.write_shared(*_shared_val, 0, cfg_.valsize);
+        } else {
+            sock_.write_prepare(cfg_.valsize);
+            sock_.write_commit(cfg_.valsize);
+        }
         bodlen = keylen + sizeof(MemcExtrasSet) + cfg_.valsize;
     }
 
-    // setup timestamps
-    MemReq &req = requests_.queue_emplace(op, measure, cb);
+    // setup timestamps (and size, for per-op results)
+    MemReq &req = requests_.queue_emplace(op, measure, deadline, cb);
+    req.tx_bytes = MemcHeader::SIZE + bodlen;
     req.start_ts = Generator::clock::now();
     sock_.write_cb_point(tcb_, &req);
 
@@ -135,7 +148,7 @@ uint64_t Memcache::_send_request(bool measure, RequestCB cb)
     IORx io(MemcHeader::SIZE, rcb_, 0, nullptr, &req);
     sock_.read(io);
 
-    return MemcHeader::SIZE + bodlen;
+    return req.tx_bytes;
 }
 
 /**
@@ -152,14 +165,14 @@ void Memcache::sent_request(Sock *s, void *data, int status)
 
     // add in sent timestamp to packet
     MemReq *req = reinterpret_cast<MemReq *>(data);
-    req->sent_ts = Generator::clock::now();
+    req->sent_ts = sock_.io_time();
 }
 
 /**
  * Handle parsing a response from a previous request.
  */
-size_t Memcache::recv_response(Sock *s, void *data, char *seg1, size_t n,
-                               char *seg2, size_t m, int status)
+size_t Memcache::recv_response(Sock *s, void *data, char *seg, size_t n,
+                               int status)
 {
     if (&sock_ != s) { // ensure right callback
         throw runtime_error(
@@ -167,7 +180,7 @@ size_t Memcache::recv_response(Sock *s, void *data, char *seg1, size_t n,
     } else if (status != 0) { // just delete on error
         requests_.drop(1);
         return 0;
-    } else if (n + m != MemcHeader::SIZE) { // ensure valid packet
+    } else if (n != MemcHeader::SIZE) { // ensure valid packet
         throw runtime_error("Memcache::recv_response: unexpected packet size");
     }
 
@@ -177,7 +190,7 @@ size_t Memcache::recv_response(Sock *s, void *data, char *seg1, size_t n,
         throw runtime_error(
           "Memcache::recv_response: wrong response-request packet match");
     }
-    auto now = Generator::clock::now();
+    auto now = sock_.io_time();
 
     // client-side queue time
     auto delta = req.sent_ts - req.start_ts;
@@ -197,23 +210,24 @@ size_t Memcache::recv_response(Sock *s, void *data, char *seg1, size_t n,
     uint64_t service_us =
       chrono::duration_cast<Generator::duration>(delta).count();
 
+    // service time from when the request was scheduled to be sent, so that
+    // any lateness in generating it is included.
+    delta = now - req.deadline_ts;
+    uint64_t sched_us =
+      chrono::duration_cast<Generator::duration>(delta).count();
+
     // parse packet - need to drop body
     uint32_t bodylen = 0;
     if (req.op != MemcCmd::Set) {
-        if (seg2 == nullptr) {
-            MemcHeader *hdr = reinterpret_cast<MemcHeader *>(seg1);
-            bodylen = ntohl(hdr->bodylen);
-        } else {
-            MemcHeader hdr;
-            memcpy(&hdr, seg1, n);
-            memcpy(&hdr + n, seg2, m);
-            bodylen = ntohl(hdr.bodylen);
-        }
+        const MemcHeader *hdr = reinterpret_cast<const MemcHeader *>(seg);
+        bodylen = ntohl(hdr->bodylen);
     }
 
     // record result
-    req.cb(this, queue_us, service_us, 0, MemcHeader::SIZE + bodylen,
-           req.measure);
+    Stamps ts{req.deadline_ts, req.start_ts, req.sent_ts, now,
+              static_cast<unsigned int>(req.op), req.tx_bytes};
+    req.cb(this, ts, queue_us, service_us, sched_us, 0,
+           MemcHeader::SIZE + bodylen, req.measure);
 
     return bodylen;
 }
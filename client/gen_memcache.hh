@@ -26,22 +26,30 @@ class Memcache : public Generator
         MemcCmd op;
         bool measure;
         RequestCB cb;
+        time_point deadline_ts;
         time_point start_ts;
         time_point sent_ts;
+        uint64_t tx_bytes;
 
-        MemReq(void) noexcept : MemReq(MemcCmd::Get, false, nullptr) {}
+        MemReq(void) noexcept
+          : MemReq(MemcCmd::Get, false, time_point{}, nullptr)
+        {
+        }
 
-        MemReq(MemcCmd o, bool m, RequestCB c) noexcept : op{o},
-                                                          measure{m},
-                                                          cb{c},
-                                                          start_ts{},
-                                                          sent_ts{}
+        MemReq(MemcCmd o, bool m, time_point d, RequestCB c) noexcept
+          : op{o},
+            measure{m},
+            cb{c},
+            deadline_ts{d},
+            start_ts{},
+            sent_ts{},
+            tx_bytes{0}
         {
         }
     };
 
     /* Buffer for tracking requests outstanding */
-    using req_buffer = buffer<MemReq, MAX_OUTSTANDING_REQS>;
+    using req_buffer = block_queue<MemReq, MAX_OUTSTANDING_REQS>;
 
     const Config &cfg_;
     std::mt19937 rand_;
@@ -56,11 +64,12 @@ class Memcache : public Generator
     char *choose_val(uint64_t id, uint32_t &n);
 
     void sent_request(Sock *s, void *data, int status);
-    size_t recv_response(Sock *sock, void *data, char *seg1, size_t n,
-                         char *seg2, size_t m, int status);
+    size_t recv_response(Sock *sock, void *data, char *seg, size_t n,
+                         int status);
 
   protected:
-    uint64_t _send_request(bool measure, RequestCB cb) override;
+    uint64_t _send_request(bool measure, time_point deadline,
+                           RequestCB cb) override;
 
   public:
     Memcache(const Config &cfg, std::mt19937 &&rand);
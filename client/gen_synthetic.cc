@@ -21,7 +21,7 @@ Synthetic::Synthetic(const Config &cfg, mt19937 &rand) noexcept
     rand_{rand},
     service_dist_exp_{1.0 / cfg.service_us},
     service_dist_lognorm_{log(cfg.service_us) - 2.0, 2.0},
-    rcb_{bind(&Synthetic::recv_response, this, _1, _2, _3, _4, _5, _6, _7)},
+    rcb_{bind(&Synthetic::recv_response, this, _1, _2, _3, _4, _5)},
     tcb_{bind(&Synthetic::sent_request, this, _1, _2, _3)},
     requests_{}
 {
@@ -44,29 +44,18 @@ uint64_t Synthetic::gen_service_time(void)
 /**
  * Generate and send a new request.
  */
-uint64_t Synthetic::_send_request(bool measure, RequestCB cb)
+uint64_t Synthetic::_send_request(bool measure, time_point deadline,
+                                  RequestCB cb)
 {
     // create our SynReq
-    SynReq &req = requests_.queue_emplace(measure, cb, gen_service_time());
-    size_t n = sizeof(req_pkt), n1 = n;
-    auto wptrs = sock_.write_prepare(n1);
-    if (n1 == n) {
-        // contiguous
-        req_pkt *pkt = (req_pkt *)wptrs.first;
-        pkt->tag = (uint64_t)&req;
-        pkt->noreply = cfg_.send_only;
-        pkt->nr = 1;
-        pkt->delays[0] = req.service_us;
-    } else {
-        // fragmented
-        req_pkt pkt;
-        pkt.tag = (uint64_t)&req;
-        pkt.noreply = cfg_.send_only;
-        pkt.nr = 1;
-        pkt.delays[0] = req.service_us;
-        memcpy(wptrs.first, &pkt, n1);
-        memcpy(wptrs.second, &pkt + n1, n - n1);
-    }
+    SynReq &req =
+      requests_.queue_emplace(measure, deadline, cb, gen_service_time());
+    size_t n = sizeof(req_pkt);
+    req_pkt *pkt = reinterpret_cast<req_pkt *>(sock_.write_prepare(n));
+    pkt->tag = (uint64_t)&req;
+    pkt->noreply = cfg_.send_only;
+    pkt->nr = 1;
+    pkt->delays[0] = req.service_us;
     sock_.write_commit(n);
 
     // setup timestamps
@@ -82,7 +71,8 @@ uint64_t Synthetic::_send_request(bool measure, RequestCB cb)
 
     // fake response if send-only mode
     if (cfg_.send_only) {
-        req.cb(this, 0, 0, 0, 0, measure);
+        Stamps ts{deadline, req.start_ts, req.start_ts, req.start_ts, 0, n};
+        req.cb(this, ts, 0, 0, 0, 0, 0, measure);
     }
 
     return n;
@@ -102,17 +92,16 @@ void Synthetic::sent_request(Sock *s, void *data, int status)
 
     // add in sent timestamp to packet
     SynReq *req = reinterpret_cast<SynReq *>(data);
-    req->sent_ts = Generator::clock::now();
+    req->sent_ts = sock_.io_time();
 }
 
 /**
  * Handle parsing a response from a previous request.
  */
-size_t Synthetic::recv_response(Sock *s, void *data, char *seg1, size_t n,
-                                char *seg2, size_t m, int status)
+size_t Synthetic::recv_response(Sock *s, void *data, char *seg, size_t n,
+                                int status)
 {
-    UNUSED(seg1);
-    UNUSED(seg2);
+    UNUSED(seg);
 
     if (&sock_ != s) { // ensure right callback
         throw runtime_error(
@@ -122,7 +111,7 @@ size_t Synthetic::recv_response(Sock *s, void *data, char *seg1, size_t n,
     if (status != 0) { // just drop on error
         requests_.drop(1);
         return 0;
-    } else if (n + m != sizeof(resp_pkt)) { // ensure valid packet
+    } else if (n != sizeof(resp_pkt)) { // ensure valid packet
         throw runtime_error(
           "Synthetic::recv_response: unexpected packet size");
     }
@@ -133,7 +122,7 @@ size_t Synthetic::recv_response(Sock *s, void *data, char *seg1, size_t n,
         throw runtime_error(
           "Synthetic::recv_response: wrong response-request packet match");
     }
-    auto now = Generator::clock::now();
+    auto now = sock_.io_time();
 
     // client-side queue time
     auto delta = req.sent_ts - req.start_ts;
@@ -153,6 +142,12 @@ size_t Synthetic::recv_response(Sock *s, void *data, char *seg1, size_t n,
     uint64_t service_us =
       chrono::duration_cast<Generator::duration>(delta).count();
 
+    // service time from when the request was scheduled to be sent, so that
+    // any lateness in generating it is included.
+    delta = now - req.deadline_ts;
+    uint64_t sched_us =
+      chrono::duration_cast<Generator::duration>(delta).count();
+
     // wait time
     uint64_t wait_us;
     if (service_us > req.service_us) {
@@ -161,7 +156,10 @@ size_t Synthetic::recv_response(Sock *s, void *data, char *seg1, size_t n,
         // measurement noise can push wait_us into negative values sometimes
         wait_us = 0;
     }
-    req.cb(this, queue_us, service_us, wait_us, sizeof(resp_pkt), req.measure);
+    Stamps ts{req.deadline_ts, req.start_ts, req.sent_ts, now, 0,
+              sizeof(req_pkt)};
+    req.cb(this, ts, queue_us, service_us, sched_us, wait_us,
+           sizeof(resp_pkt), req.measure);
 
     // no body, only a header
     return 0;
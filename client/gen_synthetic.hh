@@ -44,15 +44,17 @@ class Synthetic : public Generator
 
         bool measure;
         RequestCB cb;
+        time_point deadline_ts;
         time_point start_ts;
         time_point sent_ts;
         uint64_t service_us;
 
-        SynReq(void) noexcept : SynReq(false, nullptr, 0) {}
+        SynReq(void) noexcept : SynReq(false, time_point{}, nullptr, 0) {}
 
-        SynReq(bool m, RequestCB c, uint64_t service) noexcept
+        SynReq(bool m, time_point d, RequestCB c, uint64_t service) noexcept
           : measure{m},
             cb{c},
+            deadline_ts{d},
             start_ts{},
             sent_ts{},
             service_us{service}
@@ -61,7 +63,7 @@ class Synthetic : public Generator
     };
 
     /* Buffer for tracking requests outstanding */
-    using req_buffer = buffer<SynReq, MAX_OUTSTANDING_REQS>;
+    using req_buffer = block_queue<SynReq, MAX_OUTSTANDING_REQS>;
 
     const Config &cfg_;
     std::mt19937 &rand_;
@@ -73,11 +75,12 @@ class Synthetic : public Generator
 
     uint64_t gen_service_time(void);
     void sent_request(Sock *s, void *data, int status);
-    size_t recv_response(Sock *sock, void *data, char *seg1, size_t n,
-                         char *seg2, size_t m, int status);
+    size_t recv_response(Sock *sock, void *data, char *seg, size_t n,
+                         int status);
 
   protected:
-    uint64_t _send_request(bool measure, RequestCB cb) override;
+    uint64_t _send_request(bool measure, time_point deadline,
+                           RequestCB cb) override;
 
   public:
     Synthetic(const Config &cfg, std::mt19937 &rand) noexcept;
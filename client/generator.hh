@@ -5,9 +5,12 @@
 #include <cstdint>
 #include <functional>
 #include <random>
+#include <vector>
 
+#include "clock.hh"
 #include "opts.hh"
 #include "socket_buf.hh"
+#include "uring.hh"
 
 /**
  * Abstract class defining the interface all load generators must support.
@@ -23,21 +26,38 @@
 class Generator
 {
   public:
-    using clock = std::chrono::steady_clock;
+    using clock = Clock;
     using time_point = clock::time_point;
     using duration = std::chrono::microseconds;
-    using RequestCB = std::function<void(Generator *, uint64_t, uint64_t,
-                                         uint64_t, uint64_t, bool)>;
+
+    /* When a request was due, generated, sent and answered, its op & size */
+    struct Stamps {
+        time_point deadline;
+        time_point start;
+        time_point sent;
+        time_point recv;
+        unsigned int op;
+        uint64_t tx_bytes;
+    };
+
+    using RequestCB =
+      std::function<void(Generator *, const Stamps &, uint64_t, uint64_t,
+                         uint64_t, uint64_t, uint64_t, bool)>;
 
   protected:
     int ref_cnt_;
+    uint64_t id_;
+    uint64_t outstanding_; /* requests sent but not yet answered */
     Sock sock_;
 
     /* Generate requests - internal. */
-    virtual uint64_t _send_request(bool measure, RequestCB cb) = 0;
+    virtual uint64_t _send_request(bool measure, time_point deadline,
+                                   RequestCB cb) = 0;
 
   public:
-    Generator(void) noexcept : ref_cnt_{1}, sock_{} {}
+    Generator(void) noexcept : ref_cnt_{1}, id_{0}, outstanding_{0}, sock_{}
+    {
+    }
     virtual ~Generator(void) noexcept {}
 
     /* No copy or move */
@@ -59,18 +79,30 @@ class Generator
         }
     }
 
-    /* Generate requests */
-    uint64_t send_request(bool measure, RequestCB cb)
+    /* Generate requests, deadline is the scheduled time of the request */
+    uint64_t send_request(bool measure, time_point deadline, RequestCB cb)
     {
         get();
-        uint64_t bytes = _send_request(measure, cb);
+        outstanding_++;
+        uint64_t bytes = _send_request(measure, deadline, cb);
         put();
         return bytes;
     }
 
+    /* Identify the connection, e.g., in raw samples */
+    uint64_t id(void) const noexcept { return id_; }
+    void set_id(uint64_t id) noexcept { id_ = id; }
+
+    /* Requests sent but not yet answered (call `answered` from the cb) */
+    uint64_t outstanding(void) const noexcept { return outstanding_; }
+    void answered(void) noexcept { outstanding_--; }
+
     /* Access underlying file descriptor */
     int fd(void) const noexcept { return sock_.fd(); }
 
+    /* Timestamp sends and responses once per read/write syscall */
+    void batch_timestamps(bool on) noexcept { sock_.batch_timestamps(on); }
+
     /* Open a new remote connection */
     void connect(const char *addr, unsigned short port)
     {
@@ -84,6 +116,23 @@ class Generator
         sock_.run_io(events);
         put();
     }
+
+    /* Hold back sends until flushed, adding our socket to unflushed */
+    void cork(std::vector<Sock *> *unflushed) noexcept
+    {
+        sock_.cork(unflushed);
+    }
+
+    /* Do socket IO through an io_uring rather than epoll */
+    void use_ring(Uring *ring) { sock_.use_ring(ring, this); }
+
+    /* Handle an io_uring completion against this socket */
+    void complete_io(const Uring::Event &ev)
+    {
+        get();
+        sock_.complete(ev);
+        put();
+    }
 };
 
 #endif /* MUTATED_GENERATOR_HH */
@@ -0,0 +1,119 @@
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+#include "histfile.hh"
+#include "varint.hh"
+
+using namespace std;
+
+/* Header identifying a histogram file, and its version */
+static constexpr char HISTFILE_MAGIC[] = "MUTHFL01";
+static constexpr size_t HISTFILE_MAGIC_SIZE = sizeof(HISTFILE_MAGIC) - 1;
+
+/* Longest metric name we'll accept when reading */
+static constexpr uint64_t MAX_METRIC = 256;
+
+/**
+ * Write histograms to a file.
+ * @file: the file to write, replacing it if it exists.
+ * @entries: the histograms.
+ */
+void write_histograms(const string &file, const vector<HistEntry> &entries)
+{
+    ofstream f{file, ios::out | ios::trunc | ios::binary};
+    if (not f) {
+        throw runtime_error("write_histograms: can't open " + file);
+    }
+
+    f.write(HISTFILE_MAGIC, HISTFILE_MAGIC_SIZE);
+    write_varint(f, entries.size());
+    for (auto &e : entries) {
+        write_varint(f, e.metric.size());
+        f.write(e.metric.data(), e.metric.size());
+        write_varint(f, e.start_ms);
+        write_varint(f, e.length_ms);
+        e.hist.write(f);
+    }
+
+    f.close();
+    if (not f) {
+        throw runtime_error("write_histograms: can't write " + file);
+    }
+}
+
+/**
+ * Read the histograms of a file written by `write_histograms`.
+ * @file: the file to read.
+ */
+vector<HistEntry> read_histograms(const string &file)
+{
+    ifstream f{file, ios::in | ios::binary};
+    if (not f) {
+        throw runtime_error("read_histograms: can't open " + file);
+    }
+
+    char magic[HISTFILE_MAGIC_SIZE];
+    if (not f.read(magic, HISTFILE_MAGIC_SIZE) or
+        memcmp(magic, HISTFILE_MAGIC, HISTFILE_MAGIC_SIZE) != 0) {
+        throw runtime_error("read_histograms: not a histogram file: " + file);
+    }
+
+    uint64_t n;
+    if (not read_varint(f, n)) {
+        throw runtime_error("read_histograms: truncated file: " + file);
+    }
+
+    vector<HistEntry> entries;
+    for (uint64_t i = 0; i < n; i++) {
+        HistEntry e;
+        uint64_t len;
+        if (not read_varint(f, len) or len > MAX_METRIC) {
+            throw runtime_error("read_histograms: corrupt file: " + file);
+        }
+        e.metric.resize(len);
+        if (not f.read(&e.metric[0], len) or
+            not read_varint(f, e.start_ms) or
+            not read_varint(f, e.length_ms)) {
+            throw runtime_error("read_histograms: truncated file: " + file);
+        }
+        e.hist.read(f);
+        entries.push_back(move(e));
+    }
+    return entries;
+}
+
+/**
+ * Merge histograms into a set of them, adding any not present.
+ * @into: the set of histograms.
+ * @from: the histograms to merge in, of the same precision as those they're
+ * added to, so that merging stays exact.
+ */
+void merge_histograms(vector<HistEntry> &into, const vector<HistEntry> &from)
+{
+    map<tuple<string, uint64_t, uint64_t>, size_t> index;
+    for (size_t i = 0; i < into.size(); i++) {
+        index[make_tuple(into[i].metric, into[i].start_ms,
+                         into[i].length_ms)] = i;
+    }
+
+    for (auto &e : from) {
+        auto key = make_tuple(e.metric, e.start_ms, e.length_ms);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            index[key] = into.size();
+            into.push_back(e);
+        } else if (into[it->second].hist.precision() !=
+                   e.hist.precision()) {
+            throw runtime_error(
+              "merge_histograms: '" + e.metric + "' histograms of precision " +
+              to_string(into[it->second].hist.precision()) + " and " +
+              to_string(e.hist.precision()) +
+              " can't be merged exactly (runs with different -P?)");
+        } else {
+            into[it->second].hist.merge(e.hist);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef MUTATED_HISTFILE_HH
+#define MUTATED_HISTFILE_HH
+
+/**
+ * histfile.hh - files of latency histograms, merged across processes.
+ *
+ * A histogram file is an 8-byte magic header (which carries the format
+ * version) followed by a varint count of entries, then each entry as its
+ * metric name (varint length, then the bytes), the start and length in
+ * milliseconds of the window of the run it covers as varints (both zero for
+ * the whole measurement phase), and a histogram as serialized by
+ * `Histogram::write`. Files from any number of runs can be merged exactly:
+ * entries for the same metric and window are added together, and must be of
+ * the same precision.
+ */
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "histogram.hh"
+
+/* A histogram of a metric, over the whole run or one window of it */
+struct HistEntry {
+    std::string metric;
+    uint64_t start_ms;
+    uint64_t length_ms;
+    Histogram hist;
+
+    HistEntry(void) noexcept : metric{}, start_ms{0}, length_ms{0}, hist{} {}
+
+    HistEntry(std::string m, uint64_t start, uint64_t length, Histogram h)
+      : metric{std::move(m)},
+        start_ms{start},
+        length_ms{length},
+        hist{std::move(h)}
+    {
+    }
+};
+
+void write_histograms(const std::string &file,
+                      const std::vector<HistEntry> &entries);
+std::vector<HistEntry> read_histograms(const std::string &file);
+
+/* Merge entries into a set of them, adding any not present (throws if an
+ * entry's precision differs from the one it would be added to) */
+void merge_histograms(std::vector<HistEntry> &into,
+                      const std::vector<HistEntry> &from);
+
+#endif /* MUTATED_HISTFILE_HH */
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "histogram.hh"
+#include "varint.hh"
+
+using namespace std;
+
+/* Header identifying a serialized histogram */
+static constexpr char HIST_MAGIC[] = "MUTHST01";
+static constexpr size_t HIST_MAGIC_SIZE = sizeof(HIST_MAGIC) - 1;
+
+/* Largest precision we'll accept when reading a histogram */
+static constexpr unsigned int MAX_PRECISION = 20;
+
+static uint64_t double_bits(double d) noexcept
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+static double bits_double(uint64_t u) noexcept
+{
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+/**
+ * The bucket a value is counted in.
+ */
+size_t Histogram::bucket(uint64_t val) const noexcept
+{
+    uint64_t sub = uint64_t(1) << precision_;
+    if (val < sub) {
+        return val;
+    }
+    unsigned int shift = 63 - __builtin_clzll(val) - precision_;
+    return shift * sub + (val >> shift);
+}
+
+/**
+ * The highest value counted in a bucket.
+ */
+uint64_t Histogram::highest(size_t bucket) const noexcept
+{
+    uint64_t sub = uint64_t(1) << precision_;
+    if (bucket < 2 * sub) {
+        return bucket;
+    }
+    unsigned int shift = bucket / sub - 1;
+    uint64_t lowest = (bucket - shift * sub) << shift;
+    return lowest + (uint64_t(1) << shift) - 1;
+}
+
+void Histogram::clear(void)
+{
+    counts_.clear();
+    size_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0;
+    sum_sq_ = 0;
+}
+
+void Histogram::add_sample(uint64_t val)
+{
+    size_t b = bucket(val);
+    if (b >= counts_.size()) {
+        counts_.resize(b + 1);
+    }
+    counts_[b]++;
+    size_++;
+    min_ = std::min(min_, val);
+    max_ = std::max(max_, val);
+    sum_ += val;
+    sum_sq_ += double(val) * val;
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    if (other.precision_ != precision_) {
+        // re-bucket at our precision, using each bucket's highest value
+        for (size_t i = 0; i < other.counts_.size(); i++) {
+            if (other.counts_[i] > 0) {
+                size_t b = bucket(other.highest(i));
+                if (b >= counts_.size()) {
+                    counts_.resize(b + 1);
+                }
+                counts_[b] += other.counts_[i];
+            }
+        }
+    } else {
+        if (other.counts_.size() > counts_.size()) {
+            counts_.resize(other.counts_.size());
+        }
+        for (size_t i = 0; i < other.counts_.size(); i++) {
+            counts_[i] += other.counts_[i];
+        }
+    }
+    size_ += other.size_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+    sum_sq_ += other.sum_sq_;
+}
+
+/**
+ * Print the samples, each as the highest value of its bucket.
+ */
+void Histogram::print_samples(void) const
+{
+    for (size_t i = 0; i < counts_.size(); i++) {
+        uint64_t val = std::min(highest(i), max_);
+        for (uint64_t j = 0; j < counts_[i]; j++) {
+            cout << val << '\n';
+        }
+    }
+    cout.flush();
+}
+
+/**
+ * Serialize the histogram.
+ * @out: the stream to write to.
+ */
+void Histogram::write(ostream &out) const
+{
+    out.write(HIST_MAGIC, HIST_MAGIC_SIZE);
+    write_varint(out, precision_);
+    write_varint(out, size_);
+    write_varint(out, min_);
+    write_varint(out, max_);
+    write_varint(out, double_bits(sum_));
+    write_varint(out, double_bits(sum_sq_));
+
+    uint64_t buckets = count_if(counts_.begin(), counts_.end(),
+                                [](uint64_t c) { return c > 0; });
+    write_varint(out, buckets);
+    size_t last = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        if (counts_[i] > 0) {
+            write_varint(out, i - last);
+            write_varint(out, counts_[i]);
+            last = i;
+        }
+    }
+}
+
+/**
+ * Replace the histogram with one serialized by `write`.
+ * @in: the stream to read from.
+ */
+void Histogram::read(istream &in)
+{
+    char magic[HIST_MAGIC_SIZE];
+    if (not in.read(magic, HIST_MAGIC_SIZE) or
+        memcmp(magic, HIST_MAGIC, HIST_MAGIC_SIZE) != 0) {
+        throw runtime_error("Histogram::read: not a histogram");
+    }
+
+    uint64_t v[7];
+    for (auto &x : v) {
+        if (not read_varint(in, x)) {
+            throw runtime_error("Histogram::read: truncated histogram");
+        }
+    }
+    if (v[0] > MAX_PRECISION) {
+        throw runtime_error("Histogram::read: invalid precision");
+    }
+
+    clear();
+    precision_ = v[0];
+    size_ = v[1];
+    min_ = v[2];
+    max_ = v[3];
+    sum_ = bits_double(v[4]);
+    sum_sq_ = bits_double(v[5]);
+
+    size_t b = 0;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < v[6]; i++) {
+        uint64_t delta, count;
+        if (not read_varint(in, delta) or not read_varint(in, count)) {
+            throw runtime_error("Histogram::read: truncated histogram");
+        }
+        b += delta;
+        if (b > bucket(max_)) {
+            throw runtime_error("Histogram::read: bucket out of range");
+        }
+        if (b >= counts_.size()) {
+            counts_.resize(b + 1);
+        }
+        counts_[b] += count;
+        total += count;
+    }
+    if (total != size_) {
+        throw runtime_error("Histogram::read: inconsistent sample count");
+    }
+}
+
+double Histogram::mean(void) const { return size_ ? sum_ / size_ : 0; }
+
+double Histogram::stddev(void) const
+{
+    if (size_ == 0) {
+        return 0;
+    }
+    double avg = mean();
+    return sqrt(std::max(0.0, sum_sq_ / size_ - avg * avg));
+}
+
+uint64_t Histogram::percentile(double percent) const
+{
+    uint64_t rank = std::max(uint64_t(1), uint64_t(ceil(size_ * percent)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(highest(i), max_);
+        }
+    }
+    return max_;
+}
+
+/**
+ * The number of samples greater than a value (to the histogram's precision).
+ */
+uint64_t Histogram::count_above(uint64_t val) const
+{
+    uint64_t n = 0;
+    for (size_t i = bucket(val) + 1; i < counts_.size(); i++) {
+        n += counts_[i];
+    }
+    return n;
+}
@@ -0,0 +1,72 @@
+#ifndef MUTATED_HISTOGRAM_HH
+#define MUTATED_HISTOGRAM_HH
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/**
+ * A log-bucketed sample histogram.
+ *
+ * Values below 2^precision are counted exactly; above that each power of two
+ * is split into 2^precision linear buckets, so any value is reported within a
+ * relative error of 2^-precision. Memory grows only with the largest value
+ * seen, not with the number of samples.
+ *
+ * Histograms can be merged and serialized. The binary format is an 8-byte
+ * magic header followed by unsigned LEB128 varints: the precision, number of
+ * samples, min, max, the bits of the (double) sum and sum of squares, the
+ * number of non-empty buckets, then each non-empty bucket as its index (as a
+ * delta from the previous one) and count.
+ */
+class Histogram
+{
+  private:
+    unsigned int precision_;
+    std::vector<uint64_t> counts_;
+    uint64_t size_;
+    uint64_t min_;
+    uint64_t max_;
+    double sum_;
+    double sum_sq_;
+
+    std::size_t bucket(uint64_t val) const noexcept;
+    uint64_t highest(std::size_t bucket) const noexcept;
+
+  public:
+    using size_type = uint64_t;
+
+    explicit Histogram(unsigned int precision = 5) noexcept
+      : precision_{precision}
+      , counts_{}
+      , size_{0}
+      , min_{UINT64_MAX}
+      , max_{0}
+      , sum_{0}
+      , sum_sq_{0}
+    {
+    }
+
+    ~Histogram(void) noexcept {}
+
+    void clear(void);
+    void add_sample(uint64_t val);
+    void merge(const Histogram &other);
+    void print_samples(void) const;
+
+    /* Serialize, or replace our contents with a serialized histogram */
+    void write(std::ostream &out) const;
+    void read(std::istream &in);
+
+    double mean(void) const;
+    double stddev(void) const;
+    uint64_t percentile(double percent) const;
+    uint64_t count_above(uint64_t val) const;
+    uint64_t min(void) const noexcept { return size_ ? min_ : 0; }
+    uint64_t max(void) const noexcept { return max_; }
+    size_type size(void) const noexcept { return size_; }
+    unsigned int precision(void) const noexcept { return precision_; }
+};
+
+#endif /* MUTATED_HISTOGRAM_HH */
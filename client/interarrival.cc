@@ -0,0 +1,140 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "interarrival.hh"
+
+using namespace std;
+
+/* Largest burst generated by the bursty distribution */
+static constexpr uint64_t MAX_BURST = 1024;
+
+/**
+ * Return the shape to use for a distribution, applying its default if none
+ * was specified.
+ */
+static double default_shape(Config::distributions dist, double shape)
+{
+    if (shape != 0) {
+        return shape;
+    }
+
+    switch (dist) {
+    case Config::NORMAL:
+        return 0.25;
+    case Config::LOG_NORMAL:
+        return 1.0;
+    case Config::PARETO:
+    case Config::BURSTY:
+        return 1.5;
+    case Config::GEV:
+        return 0.15;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Return the shape to use for a distribution (see `default_shape`), checking
+ * that it's valid for the distribution, before anything is built from it.
+ */
+static double checked_shape(Config::distributions dist, double shape)
+{
+    shape = default_shape(dist, shape);
+    if (dist == Config::PARETO or dist == Config::BURSTY) {
+        if (shape <= 1) {
+            throw invalid_argument(
+              "InterArrival: pareto alpha must be greater than 1");
+        }
+    } else if (dist == Config::GEV) {
+        if (shape <= 0 or shape >= 1) {
+            throw invalid_argument("InterArrival: gev xi must be in (0, 1)");
+        }
+    } else if (shape < 0) {
+        throw invalid_argument("InterArrival: shape must be positive");
+    }
+    return shape;
+}
+
+/**
+ * Construct a new inter-arrival time generator. The shape is checked before
+ * any distribution is built from it; the normal and log-normal ones get a
+ * placeholder spread when the shape is another distribution's (maybe zero).
+ * @dist: the distribution to draw from.
+ * @shape: the distribution shape, or zero for the default.
+ */
+InterArrival::InterArrival(Config::distributions dist, double shape)
+  : dist_{dist}
+  , shape_{checked_shape(dist, shape)}
+  , uniform_{0, 2.0}
+  , exp_{1.0}
+  , normal_{1.0, shape_ > 0 ? shape_ : 1.0}
+  , lognorm_{-shape_ * shape_ / 2, shape_ > 0 ? shape_ : 1.0}
+  , pareto_xm_{0}
+  , gev_mu_{0}
+  , gev_sigma_{0}
+  , burst_mean_{0}
+  , burst_left_{0}
+{
+    if (dist_ == Config::PARETO or dist_ == Config::BURSTY) {
+        pareto_xm_ = (shape_ - 1) / shape_;
+
+        // bursts are floor(pareto(1, alpha)) capped at MAX_BURST, so the
+        // tail sum of their survival function gives the mean burst size.
+        for (uint64_t k = 1; k <= MAX_BURST; k++) {
+            burst_mean_ += pow(double(k), -shape_);
+        }
+    } else if (dist_ == Config::GEV) {
+        // place the lower bound of the support at zero and the mean at one
+        gev_mu_ = 1.0 / tgamma(1 - shape_);
+        gev_sigma_ = shape_ * gev_mu_;
+    }
+}
+
+/**
+ * Draw from a pareto distribution.
+ * @rand: the random number generator to use.
+ * @xm: the scale (minimum value).
+ * @alpha: the tail index.
+ */
+double InterArrival::pareto(mt19937 &rand, double xm, double alpha)
+{
+    // uniform on (0, 1]
+    double u = 1.0 - generate_canonical<double, 53>(rand);
+    return xm * pow(u, -1.0 / alpha);
+}
+
+/**
+ * Draw the next inter-arrival time, the mean of all distributions is one.
+ * @rand: the random number generator to use.
+ */
+double InterArrival::operator()(mt19937 &rand)
+{
+    switch (dist_) {
+    case Config::FIXED:
+        return 1.0;
+    case Config::UNIFORM:
+        return uniform_(rand);
+    case Config::NORMAL:
+        return max(0.0, normal_(rand));
+    case Config::LOG_NORMAL:
+        return lognorm_(rand);
+    case Config::PARETO:
+        return pareto(rand, pareto_xm_, shape_);
+    case Config::GEV: {
+        double u = 1.0 - generate_canonical<double, 53>(rand);
+        return gev_mu_ + gev_sigma_ * (pow(-log(u), -shape_) - 1) / shape_;
+    }
+    case Config::BURSTY:
+        if (burst_left_ > 0) {
+            burst_left_--;
+            return 0;
+        }
+        burst_left_ = min(uint64_t(pareto(rand, 1.0, shape_)), MAX_BURST) - 1;
+        return burst_mean_ * exp_(rand);
+    case Config::EXPONENTIAL:
+    default:
+        // Exponential distribution suggested by experimental evidence, c.f.
+        // Figure 11 in "Power Management of Online Data-Intensive Services"
+        return exp_(rand);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MUTATED_INTERARRIVAL_HH
+#define MUTATED_INTERARRIVAL_HH
+
+/**
+ * interarrival.hh - inter-arrival time distributions for request schedules.
+ */
+
+#include <cstdint>
+#include <random>
+
+#include "opts.hh"
+
+/**
+ * Generates inter-arrival times for a request schedule. Every distribution is
+ * scaled to have a mean of one, so the caller multiplies samples by the mean
+ * inter-arrival time it wants (i.e., 1 / rate).
+ *
+ * The bursty distribution models heavy-tailed traffic as bursts of requests
+ * sent back-to-back, with burst sizes drawn from a (discrete) Pareto
+ * distribution and exponentially distributed gaps between bursts.
+ */
+class InterArrival
+{
+  private:
+    const Config::distributions dist_;
+    const double shape_;
+
+    std::uniform_real_distribution<double> uniform_;
+    std::exponential_distribution<double> exp_;
+    std::normal_distribution<double> normal_;
+    std::lognormal_distribution<double> lognorm_;
+
+    double pareto_xm_;    /* pareto scale */
+    double gev_mu_;       /* gev location */
+    double gev_sigma_;    /* gev scale */
+    double burst_mean_;   /* mean bursty burst size */
+    uint64_t burst_left_; /* requests left in current bursty burst */
+
+    double pareto(std::mt19937 &rand, double xm, double alpha);
+
+  public:
+    InterArrival(Config::distributions dist, double shape);
+    ~InterArrival(void) noexcept {}
+
+    /* Draw the next inter-arrival time */
+    double operator()(std::mt19937 &rand);
+};
+
+#endif /* MUTATED_INTERARRIVAL_HH */
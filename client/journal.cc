@@ -0,0 +1,154 @@
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* Header identifying a journal */
+static constexpr char JOURNAL_MAGIC[] = "MUTJNL01";
+
+/* Size the journal file grows by */
+static constexpr size_t JOURNAL_CHUNK = 16 << 20;
+
+/**
+ * Unmap the journal, leaving it as it is if the run didn't finish.
+ */
+Journal::~Journal(void) noexcept
+{
+    if (base_ != nullptr) {
+        munmap(base_, size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+/**
+ * Create a journal.
+ * @file: the file to journal to.
+ * @shard: the event loop the samples come from.
+ * @req_s: the target request rate of the run.
+ */
+void Journal::open(const string &file, unsigned int shard, double req_s)
+{
+    fd_ = system_call(::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644),
+                      "Journal::open: open(" + file + ")");
+    grow();
+
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    memcpy(hdr_->magic, JOURNAL_MAGIC, sizeof(hdr_->magic));
+    hdr_->state = JOURNAL_RUNNING;
+    hdr_->shard = shard;
+    hdr_->count = 0;
+    hdr_->start_unix_ns = uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    hdr_->req_s = req_s;
+}
+
+/**
+ * Extend the journal file and its mapping by a chunk.
+ */
+void Journal::grow(void)
+{
+    size_t size = size_ + JOURNAL_CHUNK;
+    system_call(ftruncate(fd_, size), "Journal::grow: ftruncate()");
+
+    void *p;
+    if (base_ == nullptr) {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    } else {
+        p = mremap(base_, size_, size, MREMAP_MAYMOVE);
+    }
+    if (p == MAP_FAILED) {
+        throw system_error(errno, system_category(), "Journal::grow: mmap()");
+    }
+
+    base_ = reinterpret_cast<char *>(p);
+    size_ = size;
+    hdr_ = reinterpret_cast<JournalHeader *>(base_);
+    recs_ = reinterpret_cast<JournalRecord *>(hdr_ + 1);
+    cap_ = (size_ - sizeof(JournalHeader)) / sizeof(JournalRecord);
+}
+
+void Journal::restart(double req_s)
+{
+    // undo any truncation by `finish`
+    system_call(ftruncate(fd_, size_), "Journal::restart: ftruncate()");
+    hdr_->count = 0;
+    hdr_->state = JOURNAL_RUNNING;
+    hdr_->req_s = req_s;
+}
+
+void Journal::finish(void)
+{
+    hdr_->state = JOURNAL_COMPLETE;
+    size_t used = sizeof(JournalHeader) + hdr_->count * sizeof(JournalRecord);
+    system_call(msync(base_, size_, MS_SYNC), "Journal::finish: msync()");
+    system_call(ftruncate(fd_, used), "Journal::finish: ftruncate()");
+}
+
+/**
+ * Map a journal for reading.
+ * @file: the journal file.
+ */
+JournalReader::JournalReader(const string &file)
+  : fd_{-1}
+  , base_{nullptr}
+  , size_{0}
+  , hdr_{nullptr}
+  , count_{0}
+{
+    struct stat st;
+
+    fd_ = system_call(::open(file.c_str(), O_RDONLY),
+                      "JournalReader: open(" + file + ")");
+    system_call(fstat(fd_, &st), "JournalReader: fstat()");
+    if (size_t(st.st_size) < sizeof(JournalHeader)) {
+        throw runtime_error("JournalReader: not a journal: " + file);
+    }
+
+    size_ = st.st_size;
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        throw system_error(errno, system_category(), "JournalReader: mmap()");
+    }
+    base_ = reinterpret_cast<const char *>(p);
+    hdr_ = reinterpret_cast<const JournalHeader *>(base_);
+
+    if (memcmp(hdr_->magic, JOURNAL_MAGIC, sizeof(hdr_->magic)) != 0) {
+        throw runtime_error("JournalReader: not a journal: " + file);
+    }
+
+    // never trust the count beyond what the file holds
+    uint64_t fits = (size_ - sizeof(JournalHeader)) / sizeof(JournalRecord);
+    count_ = hdr_->count < fits ? hdr_->count : fits;
+}
+
+JournalReader::~JournalReader(void) noexcept
+{
+    if (base_ != nullptr) {
+        munmap(const_cast<char *>(base_), size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool JournalReader::is_journal(const string &file)
+{
+    char magic[sizeof(JournalHeader::magic)];
+    ifstream f{file, ios::in | ios::binary};
+    return f.read(magic, sizeof(magic)) and
+           memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0;
+}
@@ -0,0 +1,136 @@
+#ifndef MUTATED_JOURNAL_HH
+#define MUTATED_JOURNAL_HH
+
+/**
+ * journal.hh - a crash-safe journal of the measured samples of a run.
+ *
+ * The journal is a file mapped shared into memory, so every sample appended
+ * to it is in the page cache (and so reaches the disk) even if the process
+ * then aborts or is killed. It holds a fixed-size header followed by one
+ * fixed-size record per measured sample; the header's count only covers
+ * records completely written, and its state says whether the run finished.
+ */
+
+#include <cstdint>
+#include <string>
+
+/* Header of a journal file */
+struct JournalHeader {
+    char magic[8];
+    uint32_t state;         /* JOURNAL_RUNNING or JOURNAL_COMPLETE */
+    uint32_t shard;         /* the event loop the samples come from */
+    uint64_t count;         /* the number of records */
+    uint64_t start_unix_ns; /* wall-clock time the journal was started */
+    double req_s;           /* the target request rate of the run */
+};
+
+/* A measured sample, latencies in microseconds */
+struct JournalRecord {
+    uint64_t recv_ns; /* response time, from the start of the experiment */
+    uint32_t queue_us;
+    uint32_t service_us;
+    uint32_t wait_us;
+    uint32_t sched_us;
+};
+
+static constexpr uint32_t JOURNAL_RUNNING = 0;
+static constexpr uint32_t JOURNAL_COMPLETE = 1;
+
+/**
+ * Appends samples to a journal, growing its mapping as needed.
+ */
+class Journal
+{
+  private:
+    int fd_;
+    char *base_;       /* start of mapping */
+    std::size_t size_; /* size of mapping (and file) */
+    JournalHeader *hdr_;
+    JournalRecord *recs_;
+    uint64_t cap_; /* records that fit in the mapping */
+
+    void grow(void);
+
+  public:
+    Journal(void) noexcept : fd_{-1},
+                             base_{nullptr},
+                             size_{0},
+                             hdr_{nullptr},
+                             recs_{nullptr},
+                             cap_{0}
+    {
+    }
+    ~Journal(void) noexcept;
+
+    /* No copy or move */
+    Journal(const Journal &) = delete;
+    Journal(Journal &&) = delete;
+    Journal &operator=(const Journal &) = delete;
+    Journal &operator=(Journal &&) = delete;
+
+    void open(const std::string &file, unsigned int shard, double req_s);
+    bool is_open(void) const noexcept { return fd_ >= 0; }
+
+    /* Discard all records, for a new run at a new rate */
+    void restart(double req_s);
+
+    /* Mark the run complete, truncating the file to the records written */
+    void finish(void);
+
+    void append(uint64_t recv_ns, uint64_t queue_us, uint64_t service_us,
+                uint64_t wait_us, uint64_t sched_us)
+    {
+        uint64_t n = hdr_->count;
+        if (n == cap_) {
+            grow();
+        }
+        recs_[n] = {recv_ns, clamp(queue_us), clamp(service_us),
+                    clamp(wait_us), clamp(sched_us)};
+        // only count the record once it's written
+        __atomic_store_n(&hdr_->count, n + 1, __ATOMIC_RELEASE);
+    }
+
+    static uint32_t clamp(uint64_t us) noexcept
+    {
+        return us > UINT32_MAX ? UINT32_MAX : us;
+    }
+};
+
+/**
+ * Reads a journal, complete or left behind by an aborted run.
+ */
+class JournalReader
+{
+  private:
+    int fd_;
+    const char *base_;
+    std::size_t size_;
+    const JournalHeader *hdr_;
+    uint64_t count_;
+
+  public:
+    explicit JournalReader(const std::string &file);
+    ~JournalReader(void) noexcept;
+
+    /* No copy or move */
+    JournalReader(const JournalReader &) = delete;
+    JournalReader(JournalReader &&) = delete;
+    JournalReader &operator=(const JournalReader &) = delete;
+    JournalReader &operator=(JournalReader &&) = delete;
+
+    /* Is the file a journal? */
+    static bool is_journal(const std::string &file);
+
+    const JournalHeader &header(void) const noexcept { return *hdr_; }
+    bool complete(void) const noexcept
+    {
+        return hdr_->state == JOURNAL_COMPLETE;
+    }
+    uint64_t size(void) const noexcept { return count_; }
+    const JournalRecord &operator[](uint64_t i) const noexcept
+    {
+        return reinterpret_cast<const JournalRecord *>(hdr_ + 1)[i];
+    }
+};
+
+#endif /* MUTATED_JOURNAL_HH */
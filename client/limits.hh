@@ -10,7 +10,42 @@
 /* Maximum number of outstanding read IO operations */
 constexpr std::size_t MAX_OUTSTANDING_REQS = 1000000;
 
-/* Size of the TX & RX buffers */
+/* Maximum size of the TX & RX buffers (they grow to it on demand) */
 constexpr std::size_t CHARBUF_SIZE = 200 * 1024 * 1024;
 
+/* Memory pool: smallest block (and block of request queues), initial size of
+ * the TX & RX buffers, largest free block kept for reuse, and most memory
+ * kept in free blocks of each size */
+constexpr std::size_t POOL_BLOCK_SIZE = 4096;
+constexpr std::size_t CHARBUF_MIN = 16 * 1024;
+constexpr std::size_t POOL_MAX_CACHED = 16 * 1024 * 1024;
+constexpr std::size_t POOL_MAX_FREE = 64 * 1024 * 1024;
+
+/* io_uring backend (-U): submission queue entries, completion queue entries
+ * per submission entry, receive buffers (a power of two) and their size, and
+ * how long an idle SQPOLL kernel thread spins before sleeping */
+constexpr unsigned int URING_ENTRIES = 4096;
+constexpr unsigned int URING_CQ_FACTOR = 4;
+constexpr unsigned int URING_BUFS = 512;
+constexpr std::size_t URING_BUF_SIZE = 16 * 1024;
+constexpr unsigned int URING_SQPOLL_IDLE_MS = 1000;
+
+/* Smallest memcache SET value sent from shared memory without copying */
+constexpr std::size_t SHARED_VALUE_MIN = 16 * 1024;
+
+/* Number of request deadlines generated ahead of the sender at a time */
+constexpr std::size_t SCHEDULE_CHUNK = 4096;
+
+/* SLO capacity search: maximum load steps, when to stop bisecting (relative
+ * width of the remaining interval), the fraction of the target rate a step
+ * must hit to pass, and the warm-up of every step after the first */
+constexpr unsigned int SEARCH_MAX_STEPS = 16;
+constexpr double SEARCH_PRECISION = 0.02;
+constexpr double SEARCH_MIN_HIT = 0.95;
+constexpr uint64_t SEARCH_WARMUP_SECONDS = 1;
+
+/* Precision of the histograms saved with -E when keeping every sample (values
+ * within 0.1%) */
+constexpr unsigned int HIST_SAVE_PRECISION = 10;
+
 #endif /* MUTATED_LIMITS_HH */
@@ -3,7 +3,10 @@
 
 #if defined(__linux__)
 
+#include <pthread.h>
+#include <sched.h>
 #include <sys/epoll.h>
+#include <sys/sendfile.h>
 #include <sys/timerfd.h>
 #include <sys/syscall.h>
 #include <unistd.h>
@@ -17,6 +20,27 @@ static inline int epoll_spin(int epfd, struct epoll_event *events,
     return (int)syscall(321, epfd, events, maxevents, timeout);
 }
 
+/**
+ * Pin a thread to the n'th CPU (modulo) of those our process may run on.
+ */
+static inline void pin_thread(pthread_t thread, unsigned int n)
+{
+    cpu_set_t allowed, set;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+
+    n %= CPU_COUNT(&allowed);
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) and n-- == 0) {
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(thread, sizeof(set), &set);
+            return;
+        }
+    }
+}
+
 #else /* !linux */
 
 #include <stdexcept>
@@ -77,6 +101,29 @@ static inline int timerfd_settime(int, int, itimerspec *, void *)
     throw std::runtime_error("timerfd_settime not supported");
 }
 
+#define MFD_CLOEXEC 0
+#define MFD_ALLOW_SEALING 0
+#define F_ADD_SEALS 0
+#define F_SEAL_SHRINK 0
+#define F_SEAL_GROW 0
+#define F_SEAL_WRITE 0
+#define F_SEAL_SEAL 0
+
+static inline int memfd_create(const char *, unsigned int)
+{
+    throw std::runtime_error("memfd_create not supported");
+}
+
+static inline ssize_t sendfile(int, int, off_t *, size_t)
+{
+    throw std::runtime_error("sendfile not supported");
+}
+
+/**
+ * Thread pinning isn't supported, so just let the OS schedule threads.
+ */
+template <typename T> static inline void pin_thread(T, unsigned int) {}
+
 #endif /* !linux */
 
 #endif /* MUTATED_LINUX_COMPAT_HH */
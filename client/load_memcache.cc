@@ -147,7 +147,7 @@ MemcacheLoad::MemcacheLoad(const char *addr, unsigned short port,
                            uint64_t startid, uint64_t batch, uint64_t notify)
   : epollfd_{system_call(epoll_create1(0), "MemcacheLoad: epoll_create1()")}
   , sock_{make_unique<Sock>()}
-  , cb_{bind(&MemcacheLoad::recv_response, this, _1, _2, _3, _4, _5, _6, _7)}
+  , cb_{bind(&MemcacheLoad::recv_response, this, _1, _2, _3, _4, _5)}
   , toload_{toload}
   , sent_{0}
   , recv_{0}
@@ -255,12 +255,11 @@ void MemcacheLoad::send_request(uint64_t seqid, bool quiet)
     }
 }
 
-size_t MemcacheLoad::recv_response(Sock *s, void *data, char *seg1, size_t n,
-                                   char *seg2, size_t m, int status)
+size_t MemcacheLoad::recv_response(Sock *s, void *data, char *seg, size_t n,
+                                   int status)
 {
     UNUSED(data);
-    UNUSED(seg1);
-    UNUSED(seg2);
+    UNUSED(seg);
 
     // sanity checks
     if (sock_.get() != s) { // ensure right callback
@@ -268,7 +267,7 @@ size_t MemcacheLoad::recv_response(Sock *s, void *data, char *seg1, size_t n,
           "MemcacheLoad::recv_response: wrong socket in callback");
     } else if (status != 0) { // just return on error
         return 0;
-    } else if (n + m != MemcHeader::SIZE) { // ensure valid packet
+    } else if (n != MemcHeader::SIZE) { // ensure valid packet
         throw runtime_error(
           "MemcacheLoad::recv_response: unexpected packet size");
     }
@@ -30,8 +30,8 @@ class MemcacheLoad
 
     void epoll_watch(int fd, void *data, uint32_t events);
     void send_request(uint64_t seqid, bool quiet);
-    size_t recv_response(Sock *s, void *data, char *seg1, size_t n, char *seg2,
-                         size_t m, int status);
+    size_t recv_response(Sock *s, void *data, char *seg, size_t n,
+                         int status);
 
     const char *next_key(uint64_t seqid);
     const char *next_val(uint64_t seqid);
@@ -0,0 +1,109 @@
+#include <cinttypes>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "histfile.hh"
+
+using namespace std;
+
+static void __printUsage(string prog, int status = EXIT_FAILURE)
+{
+    if (status != EXIT_SUCCESS) {
+        cerr << "invalid arguments!" << endl << endl;
+    }
+
+    cerr << "Usage: " << prog << " [options] <histograms>..." << endl;
+    cerr << endl;
+    cerr << "Merge the latency histograms saved with -E by any number of "
+            "runs, e.g., of"
+         << endl;
+    cerr << "many load generator processes or machines, and print their "
+            "statistics."
+         << endl;
+    cerr << endl;
+    cerr << "Options:" << endl;
+    cerr << "  -h    : help" << endl;
+    cerr << "  -o STR: also save the merged histograms to a file" << endl;
+    cerr << "  -w STR: print the windows of this metric (default: service)"
+         << endl;
+
+    exit(status);
+}
+
+/**
+ * Main method -- merge histogram files.
+ */
+int main(int argc, char *argv[])
+{
+    const char *out = nullptr;
+    string window_metric = "service";
+    int c;
+
+    while ((c = getopt(argc, argv, "ho:w:")) != -1) {
+        switch (c) {
+        case 'h':
+            __printUsage(argv[0], EXIT_SUCCESS);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'w':
+            window_metric = optarg;
+            break;
+        default:
+            __printUsage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        __printUsage(argv[0]);
+    }
+
+    try {
+        vector<HistEntry> merged;
+        for (int i = optind; i < argc; i++) {
+            merge_histograms(merged, read_histograms(argv[i]));
+        }
+        if (out != nullptr) {
+            write_histograms(out, merged);
+        }
+
+        printf("%14s: count\tmin\tavg\t\tstd\t\t99th\t99.9th\tmax\n",
+               "metric");
+        for (auto &e : merged) {
+            if (e.length_ms > 0) {
+                continue;
+            }
+            const Histogram &h = e.hist;
+            printf("%14s: %" PRIu64 "\t%" PRIu64 "\t%f\t%f\t%" PRIu64
+                   "\t%" PRIu64 "\t%" PRIu64 "\n",
+                   e.metric.c_str(), h.size(), h.min(), h.mean(), h.stddev(),
+                   h.percentile(0.99), h.percentile(0.999), h.max());
+        }
+
+        bool header = false;
+        for (auto &e : merged) {
+            if (e.length_ms == 0 or e.metric != window_metric) {
+                continue;
+            } else if (not header) {
+                printf("\n%14s: start\tcount\tavg\t\t50th\t99th\t99.9th"
+                       "\tmax\n",
+                       (window_metric + " (ms)").c_str());
+                header = true;
+            }
+            const Histogram &h = e.hist;
+            printf("%14s  %" PRIu64 "\t%" PRIu64 "\t%f\t%" PRIu64
+                   "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+                   "", e.start_ms, h.size(), h.mean(), h.percentile(0.5),
+                   h.percentile(0.99), h.percentile(0.999), h.max());
+        }
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+#include <cinttypes>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "journal.hh"
+#include "samples.hh"
+
+using namespace std;
+
+static void __printUsage(string prog, int status = EXIT_FAILURE)
+{
+    if (status != EXIT_SUCCESS) {
+        cerr << "invalid arguments!" << endl << endl;
+    }
+
+    cerr << "Usage: " << prog << " [options] <dump|journal>..." << endl;
+    cerr << endl;
+    cerr << "Print the raw samples of dumps written with -D, or journals "
+            "written with -J"
+         << endl;
+    cerr << "(even of aborted runs), times in nanoseconds from the start of "
+            "the experiment."
+         << endl;
+    cerr << endl;
+    cerr << "Options:" << endl;
+    cerr << "  -h    : help" << endl;
+    cerr << "  -m    : only print measured samples (journals only have those)"
+         << endl;
+    cerr << "  -s    : only print service times (us), one per line, like -r"
+         << endl;
+
+    exit(status);
+}
+
+/**
+ * Print the samples of a journal.
+ */
+static void print_journal(const string &file, bool service)
+{
+    JournalReader journal{file};
+    const JournalHeader &hdr = journal.header();
+
+    if (not service) {
+        printf("#journal: shard %u, %" PRIu64 " samples at %f req/s, %s\n",
+               hdr.shard, journal.size(), hdr.req_s,
+               journal.complete() ? "complete" : "incomplete (run aborted)");
+        printf("#recv\tbuffer\tservice\twait\tsched\n");
+    }
+    for (uint64_t i = 0; i < journal.size(); i++) {
+        const JournalRecord &r = journal[i];
+        if (service) {
+            printf("%u\n", r.service_us);
+        } else {
+            printf("%" PRIu64 "\t%u\t%u\t%u\t%u\n", r.recv_ns, r.queue_us,
+                   r.service_us, r.wait_us, r.sched_us);
+        }
+    }
+}
+
+/**
+ * Print the samples of a dump.
+ */
+static void print_dump(const string &file, bool measured, bool service)
+{
+    SampleReader dump{file};
+    Sample s;
+
+    if (not service) {
+        printf("#deadline\tstart\tsent\trecv\tconn\top\tmeasure\n");
+    }
+    while (dump.next(s)) {
+        if (measured and not s.measure) {
+            continue;
+        } else if (service) {
+            printf("%" PRIu64 "\n", (s.recv - s.start) / 1000);
+        } else {
+            printf("%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                   "\t%" PRIu64 "\t%u\t%d\n",
+                   s.deadline, s.start, s.sent, s.recv, s.conn, s.op,
+                   s.measure);
+        }
+    }
+}
+
+/**
+ * Main method -- decode sample dumps and journals.
+ */
+int main(int argc, char *argv[])
+{
+    bool measured = false, service = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "hms")) != -1) {
+        switch (c) {
+        case 'h':
+            __printUsage(argv[0], EXIT_SUCCESS);
+            break;
+        case 'm':
+            measured = true;
+            break;
+        case 's':
+            service = true;
+            break;
+        default:
+            __printUsage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        __printUsage(argv[0]);
+    }
+
+    try {
+        for (int i = optind; i < argc; i++) {
+            if (JournalReader::is_journal(argv[i])) {
+                print_journal(argv[i], service);
+            } else {
+                print_dump(argv[i], measured, service);
+            }
+        }
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
@@ -25,15 +25,38 @@ struct Config {
     double service_us; /* service time mean microseconds */
     double req_s;      /* requests per second */
 
+    const char *load_profile; /* load profile for measurement (or null) */
+
     uint64_t warmup_seconds;   /* number of seconds to warm up */
     uint64_t cooldown_seconds; /* number of seconds to cool down */
     uint64_t samples;          /* number of samples to measure */
+    uint64_t measure_seconds;  /* number of seconds to measure */
+
+    unsigned int hist_precision; /* histogram precision (0 = raw samples) */
+    uint64_t window_ms;          /* report per window of this (0 = never) */
+    const char *window_file;     /* file to report windows to (or stdout) */
+    const char *dump_file;       /* file to dump raw samples to (binary) */
+    const char *journal_file;    /* file to journal measured samples to */
+    const char *hist_file;       /* file to save latency histograms to */
 
     bool machine_readable; /* generate machine readable output? */
     bool use_epoll_spin;   /* use the custom epoll_spin() system call */
     bool use_busy_timer;   /* busy spin for timers, not events */
+    bool sched_latency;    /* also measure latency from scheduled send */
+    bool use_tsc;          /* timestamp with the TSC where invariant */
+    bool batch_ts;         /* timestamp once per syscall, not per request */
+    bool cork_tx;          /* flush sends once per event loop iteration */
+    uint64_t threads;      /* number of event loops (threads) to run */
+
+    enum io_backends {
+        EPOLL,
+        URING,
+        URING_SQPOLL,
+    };
+    io_backends io_backend; /* how the event loop does socket IO */
 
-    const char *save_iatimes; /* record iatimes to a file */
+    const char *save_iatimes;   /* record iatimes to a file */
+    const char *replay_iatimes; /* replay iatimes from a file */
 
     enum conn_modes {
         PER_REQUEST,
@@ -43,14 +66,28 @@ struct Config {
     conn_modes conn_mode; /* the connection mode */
     uint64_t conn_cnt;    /* the number of connections to open */
 
-    enum service_distributions {
+    enum distributions {
         FIXED,
         EXPONENTIAL,
         LOG_NORMAL,
+        UNIFORM,
+        NORMAL,
+        PARETO,
+        GEV,
+        BURSTY,
     };
-    service_distributions service_dist; /* service time distribution */
+    distributions service_dist; /* service time distribution */
+    distributions arrival_dist; /* request inter-arrival distribution */
+    double arrival_shape;       /* inter-arrival shape (0 = default) */
 
     uint64_t missed_window_us; /* packet late send threshold */
+    uint64_t spin_slack_us;    /* hybrid timer spin before deadline */
+
+    double slo_percentile; /* percentile of service time held to the SLO */
+    uint64_t slo_us;       /* SLO to search capacity under (0 = no search) */
+
+    uint64_t outstanding; /* closed-loop requests per connection (0 = open) */
+    double think_us;      /* closed-loop mean think time microseconds */
 
     /* Synthetic options */
     bool send_only; /* only send requests, don't expect response */
@@ -73,17 +110,39 @@ struct Config {
       , label{"default"}
       , service_us{0}
       , req_s{0}
+      , load_profile{nullptr}
       , warmup_seconds{5}
       , cooldown_seconds{5}
       , samples{0}
+      , measure_seconds{0}
+      , hist_precision{0}
+      , window_ms{0}
+      , window_file{nullptr}
+      , dump_file{nullptr}
+      , journal_file{nullptr}
+      , hist_file{nullptr}
       , machine_readable{false}
       , use_epoll_spin{false}
       , use_busy_timer{false}
+      , sched_latency{false}
+      , use_tsc{true}
+      , batch_ts{false}
+      , cork_tx{false}
+      , threads{1}
+      , io_backend{EPOLL}
       , save_iatimes{}
+      , replay_iatimes{}
       , conn_mode{ROUND_ROBIN}
       , conn_cnt{10}
       , service_dist{EXPONENTIAL}
+      , arrival_dist{EXPONENTIAL}
+      , arrival_shape{0}
       , missed_window_us{100}
+      , spin_slack_us{0}
+      , slo_percentile{0}
+      , slo_us{0}
+      , outstanding{0}
+      , think_us{0}
       , send_only{false}
       , records{10000}
       , keysize{30}
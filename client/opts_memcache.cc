@@ -2,6 +2,7 @@
  * opts_memcache.cc - Command line parser for memcache protocol.
  */
 
+#include <cinttypes>
 #include <cmath>
 #include <iostream>
 
@@ -34,19 +35,66 @@ static void __printUsage(string prog, int status = EXIT_FAILURE)
     cerr << "  -r    : print raw samples" << endl;
     cerr << "  -e    : use Shinjuku's epoll_spin() system call" << endl;
     cerr << "  -b    : use busy spin for timers" << endl;
-    cerr << "  -i STR: file to save inter-arrival times to" << endl;
+    cerr << "  -C OPT: timestamp clock (default: tsc)" << endl;
+    cerr << "  -B    : timestamp once per read/write syscall, not per request"
+         << endl;
+    cerr << "  -K    : cork sends, flushing each connection once per event "
+            "loop batch"
+         << endl;
+    cerr << "  -U OPT: socket IO backend (default: epoll)" << endl;
+    cerr << "  -o    : also report latency from the scheduled send time"
+         << endl;
+    cerr << "  -H INT: hybrid timer, sleep then spin for the final INT "
+            "microseconds"
+         << endl;
+    cerr << "  -i STR: file to save inter-arrival times to (.bin for binary)"
+         << endl;
+    cerr << "  -I STR: file to replay inter-arrival times from" << endl;
     cerr << "  -w INT: warm-up seconds (default: 5s)" << endl;
     cerr << "  -c INT: cool-down seconds (default: 5s)" << endl;
     cerr << "  -s INT: measurement seconds (default: 10s)" << endl;
     cerr << "  -W INT: missed send threshold microseconds (default: 100us)"
          << endl;
+    cerr << "  -P INT: keep latency histograms with INT bits of precision, "
+            "not"
+         << endl;
+    cerr << "          every sample (1-20, 5 is within 3%)" << endl;
+    cerr << "  -R INT: report latency per window of INT milliseconds as it "
+            "runs"
+         << endl;
+    cerr << "  -O STR: file to report windows to (default: stdout)" << endl;
+    cerr << "  -D STR: file to dump every request's timestamps to (binary)"
+         << endl;
+    cerr << "  -J STR: file to journal measured samples to, kept even if the "
+            "run aborts"
+         << endl;
+    cerr << "  -E STR: file to save latency histograms (and -R windows) to, "
+            "for merging"
+         << endl;
     cerr << "  -l STR: label for machine-readable output (-r)" << endl;
     cerr << "  -m OPT: connection mode (default: round_robin)" << endl;
     cerr << "  -d OPT: service time distribution (default: exponential)"
          << endl;
+    cerr << "  -a OPT: inter-arrival time distribution (default: exponential)"
+         << endl;
+    cerr << "  -A FLT: inter-arrival time distribution shape (see below)"
+         << endl;
+    cerr << "  -p STR: load profile for the measurement phase (see below)"
+         << endl;
     cerr << "  -n INT: number of connections to open (round robin/random "
             "mode)"
          << endl;
+    cerr << "  -N INT: closed loop, keep INT requests outstanding per "
+            "connection"
+         << endl;
+    cerr << "  -T FLT: closed loop mean think time microseconds (default: 0)"
+         << endl;
+    cerr << "  -S P:U: search for the highest rate whose P'th percentile "
+            "service"
+         << endl;
+    cerr << "          time stays under U microseconds (e.g., 99:500)" << endl;
+    cerr << "  -t INT: number of threads (event loops) to run (default: 1)"
+         << endl;
     cerr << endl;
     cerr << "Memcache options:" << endl;
     cerr << "  -z   INT: number of keys to use (default: 10K)" << endl;
@@ -55,7 +103,31 @@ static void __printUsage(string prog, int status = EXIT_FAILURE)
     cerr << "  -u FLOAT: ratio of set:get commands (default: 0.0)" << endl;
     cerr << endl;
     cerr << "  connection modes: per_request, round_robin, random" << endl;
+    cerr << "  timestamp clocks: tsc (if invariant, else monotonic), "
+            "monotonic"
+         << endl;
+    cerr << "  IO backends: epoll, uring, uring_sqpoll (io_uring polled by a "
+            "kernel thread)"
+         << endl;
     cerr << "  service distribution: fixed, exp, lognorm" << endl;
+    cerr << "  arrival distribution: fixed, uniform, normal, exp, lognorm, "
+            "pareto, gev,"
+         << endl;
+    cerr << "                        bursty" << endl;
+    cerr << "  arrival shape: normal - coefficient of variation (0.25)"
+         << endl;
+    cerr << "                 lognorm - sigma (1.0)" << endl;
+    cerr << "                 pareto - tail index alpha (1.5)" << endl;
+    cerr << "                 gev - shape xi (0.15)" << endl;
+    cerr << "                 bursty - burst size tail index alpha (1.5)"
+         << endl;
+    cerr << "  load profile: ramp:FROM:TO:SECS[:N], step:RATE:SECS[,...],"
+         << endl;
+    cerr << "                sine:MEAN:AMP:PERIOD:SECS, file:PATH" << endl;
+    cerr << "  (a load profile sets the measurement length in place of -s, "
+            "req/sec then"
+         << endl;
+    cerr << "   sets the warm-up and cool-down rate)" << endl;
 
     exit(status);
 }
@@ -74,7 +146,9 @@ Config parse_memcache(int argc, char *argv[])
     // unused options
     cfg.service_us = 0;
 
-    while ((c = getopt(argc, argv, "hrebi:w:s:c:W:l:m:d:n:z:k:v:u:")) != -1) {
+    while ((c = getopt(argc, argv,
+                       "hreboBKi:w:s:c:W:l:m:d:n:z:k:v:u:t:a:A:p:I:H:S:"
+                       "N:T:C:P:R:O:D:J:E:U:")) != -1) {
         switch (c) {
         case 'h':
             __printUsage(argv[0], EXIT_SUCCESS);
@@ -87,9 +161,39 @@ Config parse_memcache(int argc, char *argv[])
         case 'b':
             cfg.use_busy_timer = true;
             break;
+        case 'B':
+            cfg.batch_ts = true;
+            break;
+        case 'K':
+            cfg.cork_tx = true;
+            break;
+        case 'C':
+            if (!strcmp(optarg, "tsc"))
+                cfg.use_tsc = true;
+            else if (!strcmp(optarg, "monotonic"))
+                cfg.use_tsc = false;
+            else
+                __printUsage(argv[0]);
+            break;
+        case 'U':
+            if (!strcmp(optarg, "epoll"))
+                cfg.io_backend = Config::EPOLL;
+            else if (!strcmp(optarg, "uring"))
+                cfg.io_backend = Config::URING;
+            else if (!strcmp(optarg, "uring_sqpoll"))
+                cfg.io_backend = Config::URING_SQPOLL;
+            else
+                __printUsage(argv[0]);
+            break;
+        case 'o':
+            cfg.sched_latency = true;
+            break;
         case 'i':
             cfg.save_iatimes = optarg;
             break;
+        case 'I':
+            cfg.replay_iatimes = optarg;
+            break;
         case 'w':
             cfg.warmup_seconds = atoi(optarg);
             break;
@@ -102,6 +206,44 @@ Config parse_memcache(int argc, char *argv[])
         case 'W':
             cfg.missed_window_us = atoll(optarg);
             break;
+        case 'H':
+            cfg.spin_slack_us = atoll(optarg);
+            break;
+        case 'N':
+            cfg.outstanding = atoll(optarg);
+            break;
+        case 'T':
+            cfg.think_us = atof(optarg);
+            break;
+        case 'S':
+            if (sscanf(optarg, "%20lf:%20" SCNu64, &cfg.slo_percentile,
+                       &cfg.slo_us) != 2 or
+                cfg.slo_percentile <= 0 or cfg.slo_percentile >= 100 or
+                cfg.slo_us == 0) {
+                __printUsage(argv[0]);
+            }
+            break;
+        case 'P':
+            cfg.hist_precision = atoi(optarg);
+            if (cfg.hist_precision < 1 or cfg.hist_precision > 20) {
+                __printUsage(argv[0]);
+            }
+            break;
+        case 'R':
+            cfg.window_ms = atoll(optarg);
+            break;
+        case 'O':
+            cfg.window_file = optarg;
+            break;
+        case 'D':
+            cfg.dump_file = optarg;
+            break;
+        case 'J':
+            cfg.journal_file = optarg;
+            break;
+        case 'E':
+            cfg.hist_file = optarg;
+            break;
         case 'l':
             cfg.label = optarg;
             break;
@@ -125,9 +267,38 @@ Config parse_memcache(int argc, char *argv[])
             else
                 __printUsage(argv[0]);
             break;
+        case 'a':
+            if (!strcmp(optarg, "fixed"))
+                cfg.arrival_dist = Config::FIXED;
+            else if (!strcmp(optarg, "uniform"))
+                cfg.arrival_dist = Config::UNIFORM;
+            else if (!strcmp(optarg, "normal"))
+                cfg.arrival_dist = Config::NORMAL;
+            else if (!strcmp(optarg, "exp"))
+                cfg.arrival_dist = Config::EXPONENTIAL;
+            else if (!strcmp(optarg, "lognorm"))
+                cfg.arrival_dist = Config::LOG_NORMAL;
+            else if (!strcmp(optarg, "pareto"))
+                cfg.arrival_dist = Config::PARETO;
+            else if (!strcmp(optarg, "gev"))
+                cfg.arrival_dist = Config::GEV;
+            else if (!strcmp(optarg, "bursty"))
+                cfg.arrival_dist = Config::BURSTY;
+            else
+                __printUsage(argv[0]);
+            break;
+        case 'A':
+            cfg.arrival_shape = atof(optarg);
+            break;
+        case 'p':
+            cfg.load_profile = optarg;
+            break;
         case 'n':
             cfg.conn_cnt = atoi(optarg);
             break;
+        case 't':
+            cfg.threads = atoi(optarg);
+            break;
         case 'z':
             cfg.records = atoll(optarg);
             break;
@@ -160,10 +331,42 @@ Config parse_memcache(int argc, char *argv[])
         __printUsage(argv[0]);
     }
 
+    // the hybrid timer is an alternative to the busy timer
+    if (cfg.use_busy_timer and cfg.spin_slack_us > 0) {
+        __printUsage(argv[0]);
+    }
+
+    // epoll_spin() is an epoll call, io_uring has its own event loop
+    if (cfg.use_epoll_spin and cfg.io_backend != Config::EPOLL) {
+        __printUsage(argv[0]);
+    }
+
+    // a capacity search steps a single, rescalable, schedule
+    if (cfg.slo_us > 0 and
+        (cfg.threads > 1 or cfg.load_profile != nullptr or
+         cfg.replay_iatimes != nullptr or cfg.save_iatimes != nullptr)) {
+        __printUsage(argv[0]);
+    }
+
+    // a closed loop runs over a fixed pool of connections, for a fixed time
+    if (cfg.outstanding > 0 and
+        (cfg.conn_mode == Config::PER_REQUEST or cfg.use_busy_timer or
+         cfg.slo_us > 0 or cfg.load_profile != nullptr or
+         cfg.replay_iatimes != nullptr or cfg.save_iatimes != nullptr)) {
+        __printUsage(argv[0]);
+    }
+
+    // each thread needs at least one connection of its own
+    if (cfg.threads == 0 or (cfg.conn_mode != Config::PER_REQUEST and
+                             cfg.conn_cnt < cfg.threads)) {
+        __printUsage(argv[0]);
+    }
+
     // convert from sample seconds to sample count
     if (cfg.samples == 0) {
         cfg.samples = DEFAULT_SAMPLE_S;
     }
+    cfg.measure_seconds = cfg.samples;
     cfg.samples *= cfg.req_s;
 
     cfg.gen_argc = argc - optind - FIXED_ARGS;
@@ -0,0 +1,179 @@
+#include <cerrno>
+#include <new>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "linux_compat.hh"
+#include "pool.hh"
+#include "util.hh"
+
+using namespace std;
+
+/**
+ * The size class (log2 of the block size) serving a request of bytes.
+ */
+unsigned int BlockPool::size_class(size_t bytes) noexcept
+{
+    unsigned int c = 0;
+    while ((size_t(1) << c) < bytes or (size_t(1) << c) < POOL_BLOCK_SIZE) {
+        c++;
+    }
+    return c;
+}
+
+/**
+ * The size class of a mirrored block, which must be a multiple of the page.
+ */
+unsigned int BlockPool::mirrored_class(size_t bytes) noexcept
+{
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    return size_class(bytes < page ? page : bytes);
+}
+
+/**
+ * Whether to keep another free block of a size class, rather than release it.
+ * @blocks: the free blocks, by size class.
+ * @c: the size class.
+ */
+bool BlockPool::keep(const vector<vector<void *>> &blocks,
+                     unsigned int c) noexcept
+{
+    size_t size = size_t(1) << c;
+    if (size > POOL_MAX_CACHED) {
+        return false;
+    }
+    return c >= blocks.size() or
+           (blocks[c].size() + 1) * size <= POOL_MAX_FREE;
+}
+
+BlockPool::~BlockPool(void) noexcept
+{
+    for (auto &blocks : free_) {
+        for (void *b : blocks) {
+            ::operator delete(b);
+        }
+    }
+    for (size_t c = 0; c < mirrored_.size(); c++) {
+        for (void *b : mirrored_[c]) {
+            munmap(b, size_t(2) << c);
+        }
+    }
+}
+
+BlockPool &BlockPool::local(void)
+{
+    static thread_local BlockPool pool;
+    return pool;
+}
+
+/**
+ * Allocate a block, reusing a free one if we have one.
+ * @bytes: the size wanted, rounded up to `block_size(bytes)`.
+ */
+void *BlockPool::alloc(size_t bytes)
+{
+    unsigned int c = size_class(bytes);
+    if (c < free_.size() and not free_[c].empty()) {
+        void *b = free_[c].back();
+        free_[c].pop_back();
+        return b;
+    }
+    return ::operator new(size_t(1) << c);
+}
+
+/**
+ * Free a block, keeping it for reuse unless it's very large or we have
+ * plenty of its size.
+ * @block: the block, from `alloc` on any thread's pool.
+ * @bytes: the size it was allocated with.
+ */
+void BlockPool::free(void *block, size_t bytes) noexcept
+{
+    unsigned int c = size_class(bytes);
+    if (not keep(free_, c)) {
+        ::operator delete(block);
+        return;
+    }
+
+    try {
+        if (c >= free_.size()) {
+            free_.resize(c + 1);
+        }
+        free_[c].push_back(block);
+    } catch (const bad_alloc &) {
+        ::operator delete(block);
+    }
+}
+
+/**
+ * Allocate a mirrored block: a memory file mapped twice back-to-back, so that
+ * byte i and byte i + size are the same.
+ * @bytes: the size wanted, rounded up to `mirrored_size(bytes)`.
+ */
+void *BlockPool::alloc_mirrored(size_t bytes)
+{
+    unsigned int c = mirrored_class(bytes);
+    if (c < mirrored_.size() and not mirrored_[c].empty()) {
+        void *b = mirrored_[c].back();
+        mirrored_[c].pop_back();
+        return b;
+    }
+
+    size_t size = size_t(1) << c;
+    int fd = system_call(memfd_create("mutated-ring", MFD_CLOEXEC),
+                         "BlockPool::alloc_mirrored: memfd_create()");
+    if (ftruncate(fd, size) != 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, system_category(),
+                           "BlockPool::alloc_mirrored: ftruncate()");
+    }
+
+    // reserve room for both mappings, then place the file over each half
+    char *b = static_cast<char *>(mmap(nullptr, 2 * size, PROT_NONE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (b == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, system_category(),
+                           "BlockPool::alloc_mirrored: mmap()");
+    }
+    for (char *half : {b, b + size}) {
+        if (mmap(half, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 fd, 0) == MAP_FAILED) {
+            int err = errno;
+            munmap(b, 2 * size);
+            close(fd);
+            throw system_error(err, system_category(),
+                               "BlockPool::alloc_mirrored: mmap(MAP_FIXED)");
+        }
+    }
+    close(fd);
+    return b;
+}
+
+/**
+ * Free a mirrored block, keeping it for reuse unless it's very large or we
+ * have plenty of its size.
+ * @block: the block, from `alloc_mirrored` on any thread's pool.
+ * @bytes: the size it was allocated with.
+ */
+void BlockPool::free_mirrored(void *block, size_t bytes) noexcept
+{
+    unsigned int c = mirrored_class(bytes);
+    if (not keep(mirrored_, c)) {
+        munmap(block, size_t(2) << c);
+        return;
+    }
+
+    try {
+        if (c >= mirrored_.size()) {
+            mirrored_.resize(c + 1);
+        }
+        mirrored_[c].push_back(block);
+    } catch (const bad_alloc &) {
+        munmap(block, size_t(2) << c);
+    }
+}
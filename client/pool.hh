@@ -0,0 +1,69 @@
+#ifndef MUTATED_POOL_HH
+#define MUTATED_POOL_HH
+
+/**
+ * pool.hh - a per-thread pool of memory blocks, shared by all the socket
+ * buffers and request queues of a thread so they only hold memory for what
+ * is in flight.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "limits.hh"
+
+/**
+ * A pool of power-of-two sized memory blocks, at least POOL_BLOCK_SIZE bytes.
+ * Freed blocks are kept for reuse, up to POOL_MAX_CACHED bytes each and
+ * POOL_MAX_FREE bytes of each size, so the pool follows the demand of its
+ * thread without holding on to the memory of a past peak. Not thread-safe:
+ * each thread uses its own (`local`), although a block may be freed to a
+ * different thread's pool than it came from. Mirrored blocks (at least a
+ * page) are pooled the same way.
+ */
+class BlockPool
+{
+  private:
+    std::vector<std::vector<void *>> free_;     /* free blocks, by size class */
+    std::vector<std::vector<void *>> mirrored_; /* free mirrored blocks */
+
+    static unsigned int size_class(std::size_t bytes) noexcept;
+    static unsigned int mirrored_class(std::size_t bytes) noexcept;
+    static bool keep(const std::vector<std::vector<void *>> &blocks,
+                     unsigned int c) noexcept;
+
+  public:
+    BlockPool(void) noexcept : free_{}, mirrored_{} {}
+    ~BlockPool(void) noexcept;
+
+    /* No copy or move */
+    BlockPool(const BlockPool &) = delete;
+    BlockPool(BlockPool &&) = delete;
+    BlockPool &operator=(const BlockPool &) = delete;
+    BlockPool &operator=(BlockPool &&) = delete;
+
+    /* The pool of the calling thread */
+    static BlockPool &local(void);
+
+    /* The size of the block allocated for a request of bytes */
+    static std::size_t block_size(std::size_t bytes) noexcept
+    {
+        return std::size_t(1) << size_class(bytes);
+    }
+
+    /* The size of the mirrored block allocated for a request of bytes */
+    static std::size_t mirrored_size(std::size_t bytes) noexcept
+    {
+        return std::size_t(1) << mirrored_class(bytes);
+    }
+
+    void *alloc(std::size_t bytes);
+    void free(void *block, std::size_t bytes) noexcept;
+
+    /* A block whose pages are mapped again right after it, so that a ring
+     * buffer in it can wrap around contiguously */
+    void *alloc_mirrored(std::size_t bytes);
+    void free_mirrored(void *block, std::size_t bytes) noexcept;
+};
+
+#endif /* MUTATED_POOL_HH */
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "profile.hh"
+
+using namespace std;
+
+/* Number of segments each period of a sine profile is split into */
+static constexpr unsigned int SINE_SEGMENTS = 8;
+
+/**
+ * Split a string on a delimiter.
+ */
+static vector<string> split(const string &s, char delim)
+{
+    vector<string> parts;
+    stringstream ss(s);
+    string part;
+    while (getline(ss, part, delim)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+/**
+ * Parse a (strictly) positive number.
+ */
+static double parse_num(const string &s)
+{
+    char *end;
+    double d = strtod(s.c_str(), &end);
+    if (s.empty() or *end != '\0' or not(d > 0)) {
+        throw invalid_argument("LoadProfile: invalid number '" + s + "'");
+    }
+    return d;
+}
+
+/**
+ * Rate at time t (seconds since start of profile) within this segment.
+ */
+double LoadProfile::Segment::rate(double t) const noexcept
+{
+    double r = from + (to - from) * (t - start) / secs;
+    if (amp != 0) {
+        r += amp * sin(2 * M_PI * t / period);
+    }
+    return r;
+}
+
+/**
+ * Number of requests the segment expects (integral of the rate).
+ */
+double LoadProfile::Segment::requests(void) const noexcept
+{
+    double n = (from + to) / 2 * secs;
+    if (amp != 0) {
+        n += amp * period / (2 * M_PI) *
+             (cos(2 * M_PI * start / period) -
+              cos(2 * M_PI * (start + secs) / period));
+    }
+    return n;
+}
+
+/**
+ * Construct a new load profile from its specification.
+ * @spec: the profile specification (see profile.hh).
+ */
+LoadProfile::LoadProfile(const string &spec)
+  : segments_{}
+{
+    size_t colon = spec.find(':');
+    string kind = spec.substr(0, colon);
+    string args = colon == string::npos ? "" : spec.substr(colon + 1);
+
+    if (kind == "ramp") {
+        parse_ramp(args);
+    } else if (kind == "step") {
+        parse_step(args);
+    } else if (kind == "sine") {
+        parse_sine(args);
+    } else if (kind == "file") {
+        parse_file(args);
+    } else {
+        throw invalid_argument("LoadProfile: unknown profile '" + kind + "'");
+    }
+
+    if (segments_.empty()) {
+        throw invalid_argument("LoadProfile: empty profile");
+    }
+}
+
+/**
+ * Append a segment to the profile.
+ */
+void LoadProfile::add(double secs, double from, double to, double amp,
+                      double period)
+{
+    if (not(secs > 0)) {
+        throw invalid_argument("LoadProfile: segment length must be > 0");
+    } else if (min(from, to) - abs(amp) <= 0) {
+        throw invalid_argument("LoadProfile: request rate must stay > 0");
+    }
+    segments_.push_back({duration(), secs, from, to, amp, period});
+}
+
+void LoadProfile::parse_ramp(const string &args)
+{
+    auto a = split(args, ':');
+    if (a.size() != 3 and a.size() != 4) {
+        throw invalid_argument("LoadProfile: ramp:FROM:TO:SECS[:N]");
+    }
+
+    double from = parse_num(a[0]), to = parse_num(a[1]);
+    double secs = parse_num(a[2]);
+    double n = a.size() == 4 ? parse_num(a[3]) : max(1.0, ceil(secs));
+    double step = secs / floor(n);
+    for (unsigned int i = 0; i < floor(n); i++) {
+        add(step, from + (to - from) * i / floor(n),
+            from + (to - from) * (i + 1) / floor(n));
+    }
+}
+
+void LoadProfile::parse_step(const string &args)
+{
+    for (auto &step : split(args, ',')) {
+        auto a = split(step, ':');
+        if (a.size() != 2) {
+            throw invalid_argument("LoadProfile: step:RATE:SECS[,...]");
+        }
+        double rate = parse_num(a[0]);
+        add(parse_num(a[1]), rate, rate);
+    }
+}
+
+void LoadProfile::parse_sine(const string &args)
+{
+    auto a = split(args, ':');
+    if (a.size() != 4) {
+        throw invalid_argument("LoadProfile: sine:MEAN:AMP:PERIOD:SECS");
+    }
+
+    double mean = parse_num(a[0]), amp = parse_num(a[1]);
+    double period = parse_num(a[2]), secs = parse_num(a[3]);
+    double step = period / SINE_SEGMENTS;
+    for (double t = 0; secs - t > 1e-9; t += step) {
+        add(min(step, secs - t), mean, mean, amp, period);
+    }
+}
+
+void LoadProfile::parse_file(const string &path)
+{
+    ifstream f(path);
+    if (not f) {
+        throw invalid_argument("LoadProfile: can't open '" + path + "'");
+    }
+
+    string line;
+    double last_t = 0, last_r = 0;
+    bool first = true;
+    while (getline(f, line)) {
+        line = line.substr(0, line.find('#'));
+        double t, r;
+        stringstream ss(line);
+        if (not(ss >> t)) {
+            continue; // blank or comment line
+        } else if (not(ss >> r)) {
+            throw invalid_argument("LoadProfile: bad line '" + line + "'");
+        }
+
+        if (first) {
+            if (t != 0) {
+                throw invalid_argument(
+                  "LoadProfile: file profile must start at 0 seconds");
+            }
+            first = false;
+        } else {
+            add(t - last_t, last_r, r);
+        }
+        last_t = t;
+        last_r = r;
+    }
+}
+
+double LoadProfile::duration(void) const noexcept
+{
+    if (segments_.empty()) {
+        return 0;
+    }
+    return segments_.back().start + segments_.back().secs;
+}
+
+double LoadProfile::mean_rate(void) const noexcept
+{
+    double n = 0;
+    for (auto &s : segments_) {
+        n += s.requests();
+    }
+    return n / duration();
+}
+
+std::size_t LoadProfile::segment(double t) const noexcept
+{
+    auto it = upper_bound(
+      segments_.begin(), segments_.end(), t,
+      [](double t, const Segment &s) { return t < s.start + s.secs; });
+    if (it == segments_.end()) {
+        return segments_.size() - 1;
+    }
+    return it - segments_.begin();
+}
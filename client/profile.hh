@@ -0,0 +1,76 @@
+#ifndef MUTATED_PROFILE_HH
+#define MUTATED_PROFILE_HH
+
+/**
+ * profile.hh - time-varying load profiles for the measurement phase.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A load profile gives the target request rate as a function of time since the
+ * start of the measurement phase. It is made up of consecutive segments, each
+ * a linear ramp (or constant step) optionally with a sinusoid added on top.
+ * Results are broken down by segment.
+ *
+ * Profiles are specified as one of:
+ * - ramp:FROM:TO:SECS[:N]        - linear ramp split into N segments (default:
+ *                                  one per second).
+ * - step:RATE:SECS[,RATE:SECS..] - a sequence of constant rates.
+ * - sine:MEAN:AMP:PERIOD:SECS    - a sinusoid, eight segments per period.
+ * - file:PATH                    - piecewise-linear, one 'SECS RATE' point per
+ *                                  line, starting at zero seconds.
+ */
+class LoadProfile
+{
+  public:
+    struct Segment {
+        double start;  /* start time (seconds) */
+        double secs;   /* length (seconds) */
+        double from;   /* linear rate at start */
+        double to;     /* linear rate at end */
+        double amp;    /* sinusoid amplitude */
+        double period; /* sinusoid period (seconds) */
+
+        double rate(double t) const noexcept;
+        double requests(void) const noexcept;
+    };
+
+  private:
+    std::vector<Segment> segments_;
+
+    void add(double secs, double from, double to, double amp = 0,
+             double period = 0);
+    void parse_ramp(const std::string &args);
+    void parse_step(const std::string &args);
+    void parse_sine(const std::string &args);
+    void parse_file(const std::string &path);
+
+  public:
+    explicit LoadProfile(const std::string &spec);
+    ~LoadProfile(void) noexcept {}
+
+    /* Length of the profile (seconds) */
+    double duration(void) const noexcept;
+
+    /* Mean request rate over the whole profile */
+    double mean_rate(void) const noexcept;
+
+    /* Index of the segment covering time t (seconds), clamped to the ends */
+    std::size_t segment(double t) const noexcept;
+
+    /* Target request rate at time t (seconds) */
+    double rate(double t) const noexcept
+    {
+        return segments_[segment(t)].rate(t);
+    }
+
+    const std::vector<Segment> &segments(void) const noexcept
+    {
+        return segments_;
+    }
+};
+
+#endif /* MUTATED_PROFILE_HH */
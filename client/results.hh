@@ -1,11 +1,14 @@
 #ifndef MUTATED_RESULTS_HH
 #define MUTATED_RESULTS_HH
 
+#include <algorithm>
 #include <chrono>
 #include <vector>
 #include <stdexcept>
 
 #include "accum.hh"
+#include "clock.hh"
+#include "histogram.hh"
 #include "util.hh"
 
 /**
@@ -14,37 +17,86 @@
 class Results
 {
   public:
-    using clock = std::chrono::steady_clock;
+    using clock = Clock;
     using time_point = clock::time_point;
     using duration = std::chrono::nanoseconds;
 
+    /* Results of a single connection */
+    struct ConnResults {
+        Histogram service;
+        uint64_t sends;
+        uint64_t depth_sum; /* requests outstanding, summed over sends */
+        uint64_t depth_max;
+
+        ConnResults(void) noexcept : service{},
+                                     sends{0},
+                                     depth_sum{0},
+                                     depth_max{0}
+        {
+        }
+    };
+
+    /* Results of a single protocol operation (e.g., memcache gets) */
+    struct OpResults {
+        Accum queue;
+        Accum service;
+        uint64_t tx_bytes;
+        uint64_t rx_bytes;
+
+        explicit OpResults(unsigned int precision) noexcept
+          : queue{0, precision},
+            service{0, precision},
+            tx_bytes{0},
+            rx_bytes{0}
+        {
+        }
+    };
+
   private:
+    unsigned int precision_; /* histogram precision (0 = raw samples) */
     time_point measure_start_;
     time_point measure_end_;
     Accum queue_;
     Accum service_;
     Accum wait_;
+    Accum sched_;                 /* response time - scheduled send time */
+    Histogram lateness_;          /* send time - scheduled time (ns) */
+    std::vector<Histogram> late_secs_; /* lateness per measurement second */
+    std::vector<Accum> segments_; /* service time per load profile segment */
+    std::vector<OpResults> ops_;  /* results per operation, by opcode */
+    std::vector<ConnResults> conns_; /* results per connection, by id */
     uint64_t tx_bytes_;
     uint64_t rx_bytes_;
     double reqps_;
 
   public:
-    explicit Results(std::size_t reserve) noexcept : measure_start_{},
-                                                     measure_end_{},
-                                                     queue_{reserve},
-                                                     service_{reserve},
-                                                     wait_{reserve},
-                                                     tx_bytes_{0},
-                                                     rx_bytes_{0},
-                                                     reqps_{0}
+    explicit Results(std::size_t reserve, unsigned int precision = 0) noexcept
+      : precision_{precision},
+        measure_start_{},
+        measure_end_{},
+        queue_{reserve, precision},
+        service_{reserve, precision},
+        wait_{reserve, precision},
+        sched_{0, precision},
+        lateness_{},
+        late_secs_{},
+        segments_{},
+        ops_{},
+        conns_{},
+        tx_bytes_{0},
+        rx_bytes_{0},
+        reqps_{0}
     {
     }
 
-    void start_measurements(void) noexcept { measure_start_ = clock::now(); }
+    void start_measurements(time_point start = clock::now()) noexcept
+    {
+        measure_start_ = start;
+    }
 
-    void end_measurements(void)
+    void end_measurements(time_point end = clock::now())
     {
-        measure_end_ = clock::now();
+        measure_end_ = end;
         reqps_ = (double)service_.size() / (running_time() / NSEC);
     }
 
@@ -57,8 +109,65 @@ class Results
         return std::chrono::duration_cast<duration>(length).count();
     }
 
+    /* Break service times down by load profile segment */
+    void profile_segments(std::size_t n)
+    {
+        segments_.assign(n, Accum(0, precision_));
+    }
+
+    void add_segment_sample(std::size_t segment, uint64_t service)
+    {
+        segments_[segment].add_sample(service);
+    }
+
+    /* Break results down by connection: requests sent and their depth */
+    void add_conn_send(uint64_t conn, uint64_t depth)
+    {
+        if (conn >= conns_.size()) {
+            conns_.resize(conn + 1);
+        }
+        conns_[conn].sends++;
+        conns_[conn].depth_sum += depth;
+        conns_[conn].depth_max = std::max(conns_[conn].depth_max, depth);
+    }
+
+    void add_conn_sample(uint64_t conn, uint64_t service)
+    {
+        if (conn >= conns_.size()) {
+            conns_.resize(conn + 1);
+        }
+        conns_[conn].service.add_sample(service);
+    }
+
+    /* Break results down by protocol operation */
+    void add_op_sample(unsigned int op, uint64_t queue, uint64_t service,
+                       uint64_t tx_bytes, uint64_t rx_bytes)
+    {
+        if (op >= ops_.size()) {
+            ops_.resize(op + 1, OpResults(precision_));
+        }
+        OpResults &r = ops_[op];
+        r.queue.add_sample(queue);
+        r.service.add_sample(service);
+        r.tx_bytes += tx_bytes;
+        r.rx_bytes += rx_bytes;
+    }
+
     void sent_bytes(uint64_t tx_bytes) noexcept { tx_bytes_ += tx_bytes; }
 
+    /* Record a send's lateness, by the second of measurement it was due */
+    void add_lateness(std::size_t second, uint64_t late)
+    {
+        lateness_.add_sample(late);
+        if (second >= late_secs_.size()) {
+            late_secs_.resize(second + 1);
+        }
+        late_secs_[second].add_sample(late);
+    }
+
+    /* Coordinated-omission-free latency, see Config::sched_latency */
+    void add_sched(uint64_t sched) { sched_.add_sample(sched); }
+
     void add_sample(uint64_t queue, uint64_t service, uint64_t wait,
                     uint64_t rx_bytes)
     {
@@ -68,9 +177,60 @@ class Results
         rx_bytes_ += rx_bytes;
     }
 
+    /* Merge the results of another (concurrent) sampling run into ours. */
+    void merge(Results &other)
+    {
+        // a shard with no replies has no measurement period of its own, but
+        // still has its sends (lateness) and connections to report
+        if (other.service_.size() > 0 and service_.size() == 0) {
+            measure_start_ = other.measure_start_;
+            measure_end_ = other.measure_end_;
+        } else if (other.service_.size() > 0) {
+            measure_start_ = std::min(measure_start_, other.measure_start_);
+            measure_end_ = std::max(measure_end_, other.measure_end_);
+        }
+
+        queue_.merge(other.queue_);
+        service_.merge(other.service_);
+        wait_.merge(other.wait_);
+        sched_.merge(other.sched_);
+        lateness_.merge(other.lateness_);
+        if (other.late_secs_.size() > late_secs_.size()) {
+            late_secs_.resize(other.late_secs_.size());
+        }
+        for (std::size_t i = 0; i < other.late_secs_.size(); i++) {
+            late_secs_[i].merge(other.late_secs_[i]);
+        }
+        for (std::size_t i = 0; i < segments_.size(); i++) {
+            segments_[i].merge(other.segments_[i]);
+        }
+        if (other.ops_.size() > ops_.size()) {
+            ops_.resize(other.ops_.size(), OpResults(precision_));
+        }
+        for (std::size_t i = 0; i < other.ops_.size(); i++) {
+            ops_[i].queue.merge(other.ops_[i].queue);
+            ops_[i].service.merge(other.ops_[i].service);
+            ops_[i].tx_bytes += other.ops_[i].tx_bytes;
+            ops_[i].rx_bytes += other.ops_[i].rx_bytes;
+        }
+        // other shards' connections are distinct from ours
+        conns_.insert(conns_.end(), other.conns_.begin(), other.conns_.end());
+        tx_bytes_ += other.tx_bytes_;
+        rx_bytes_ += other.rx_bytes_;
+        if (service_.size() > 0) {
+            reqps_ = (double)service_.size() / (running_time() / NSEC);
+        }
+    }
+
     Accum &queue(void) noexcept { return queue_; }
     Accum &service(void) noexcept { return service_; }
     Accum &wait(void) noexcept { return wait_; }
+    Accum &sched(void) noexcept { return sched_; }
+    Histogram &lateness(void) noexcept { return lateness_; }
+    std::vector<Histogram> &late_seconds(void) noexcept { return late_secs_; }
+    Accum &segment(std::size_t i) noexcept { return segments_[i]; }
+    std::vector<OpResults> &ops(void) noexcept { return ops_; }
+    std::vector<ConnResults> &conns(void) noexcept { return conns_; }
 
     double reqps(void) const noexcept { return reqps_; }
     uint64_t tx_bytes(void) const noexcept { return tx_bytes_; }
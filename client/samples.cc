@@ -0,0 +1,138 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "samples.hh"
+#include "util.hh"
+#include "varint.hh"
+
+using namespace std;
+
+/* Header identifying a sample dump */
+static constexpr char SAMPLE_MAGIC[] = "MUTSMP01";
+static constexpr size_t SAMPLE_MAGIC_SIZE = sizeof(SAMPLE_MAGIC) - 1;
+
+/* Size of the write buffer, and the largest a record can encode to */
+static constexpr size_t SAMPLE_BUF_SIZE = 1 << 20;
+static constexpr size_t SAMPLE_MAX_RECORD = 6 * 10;
+
+/* Zigzag-encode the difference of two times, which may be negative */
+static uint64_t zigzag(uint64_t to, uint64_t from) noexcept
+{
+    int64_t d = int64_t(to - from);
+    return (uint64_t(d) << 1) ^ uint64_t(d >> 63);
+}
+
+static uint64_t unzigzag(uint64_t from, uint64_t z) noexcept
+{
+    return from + ((z >> 1) ^ -(z & 1));
+}
+
+/**
+ * Flush any buffered records and close the dump.
+ */
+SampleWriter::~SampleWriter(void) noexcept
+{
+    if (fd_ >= 0) {
+        try {
+            flush();
+        } catch (...) {
+            // nothing we can do about a failed write now
+        }
+        close(fd_);
+    }
+}
+
+/**
+ * Open a sample dump for writing.
+ * @file: the file to write to.
+ */
+void SampleWriter::open(const string &file)
+{
+    fd_ = system_call(::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644),
+                      "SampleWriter::open: open(" + file + ")");
+    buf_.resize(SAMPLE_BUF_SIZE);
+    memcpy(buf_.data(), SAMPLE_MAGIC, SAMPLE_MAGIC_SIZE);
+    len_ = SAMPLE_MAGIC_SIZE;
+    last_ = 0;
+}
+
+/**
+ * Append a sample to the dump.
+ * @s: the sample.
+ */
+void SampleWriter::write(const Sample &s)
+{
+    if (len_ + SAMPLE_MAX_RECORD > buf_.size()) {
+        flush();
+    }
+
+    char *p = buf_.data() + len_;
+    p += encode_varint(zigzag(s.deadline, last_), p);
+    p += encode_varint(zigzag(s.start, s.deadline), p);
+    p += encode_varint(zigzag(s.sent, s.start), p);
+    p += encode_varint(zigzag(s.recv, s.sent), p);
+    p += encode_varint(s.conn, p);
+    p += encode_varint(uint64_t(s.op) << 1 | s.measure, p);
+    len_ = p - buf_.data();
+    last_ = s.deadline;
+}
+
+/**
+ * Write out all buffered records.
+ */
+void SampleWriter::flush(void)
+{
+    for (size_t off = 0; off < len_;) {
+        off += system_call(::write(fd_, buf_.data() + off, len_ - off),
+                           "SampleWriter::flush: write()");
+    }
+    len_ = 0;
+}
+
+/**
+ * Open a sample dump for reading.
+ * @file: the file to read.
+ */
+SampleReader::SampleReader(const string &file)
+  : f_{file, ios::in | ios::binary}
+  , last_{0}
+{
+    char magic[SAMPLE_MAGIC_SIZE];
+    if (not f_) {
+        throw runtime_error("SampleReader: can't open " + file);
+    } else if (not f_.read(magic, SAMPLE_MAGIC_SIZE) or
+               memcmp(magic, SAMPLE_MAGIC, SAMPLE_MAGIC_SIZE) != 0) {
+        throw runtime_error("SampleReader: not a sample dump: " + file);
+    }
+}
+
+/**
+ * Read the next sample from the dump.
+ * @s: the sample read.
+ * @return: false if the end of the dump was reached.
+ */
+bool SampleReader::next(Sample &s)
+{
+    uint64_t v[6];
+    if (not read_varint(f_, v[0])) {
+        return false;
+    }
+    for (size_t i = 1; i < 6; i++) {
+        if (not read_varint(f_, v[i])) {
+            throw runtime_error("SampleReader::next: truncated record");
+        }
+    }
+
+    s.deadline = unzigzag(last_, v[0]);
+    s.start = unzigzag(s.deadline, v[1]);
+    s.sent = unzigzag(s.start, v[2]);
+    s.recv = unzigzag(s.sent, v[3]);
+    s.conn = v[4];
+    s.op = v[5] >> 1;
+    s.measure = v[5] & 1;
+    last_ = s.deadline;
+    return true;
+}
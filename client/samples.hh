@@ -0,0 +1,84 @@
+#ifndef MUTATED_SAMPLES_HH
+#define MUTATED_SAMPLES_HH
+
+/**
+ * samples.hh - reading and writing raw per-request sample dumps.
+ *
+ * A dump is an 8-byte magic header followed by one record per response, in
+ * the order responses arrived. Each record is a sequence of unsigned LEB128
+ * varints: the deadline as a delta from the previous record's deadline, then
+ * the start, sent and received times each as a delta from the time before it
+ * (all four zigzag-encoded, in nanoseconds), the connection, and the
+ * operation shifted left by one with the low bit set if the request was
+ * measured.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * A raw sample, times in nanoseconds from the start of the experiment.
+ */
+struct Sample {
+    uint64_t deadline; /* when the request was scheduled to be sent */
+    uint64_t start;    /* when it was generated */
+    uint64_t sent;     /* when it was written to the socket */
+    uint64_t recv;     /* when its response was read */
+    uint64_t conn;     /* the connection it was sent on */
+    unsigned int op;   /* protocol operation (memcache opcode) */
+    bool measure;      /* in the measurement phase? */
+};
+
+/**
+ * Writes a sample dump, buffering records to write them out in large chunks.
+ */
+class SampleWriter
+{
+  private:
+    int fd_;
+    std::vector<char> buf_;
+    std::size_t len_;
+    uint64_t last_; /* deadline of the previous record */
+
+  public:
+    SampleWriter(void) noexcept : fd_{-1}, buf_{}, len_{0}, last_{0} {}
+    ~SampleWriter(void) noexcept;
+
+    /* No copy or move */
+    SampleWriter(const SampleWriter &) = delete;
+    SampleWriter(SampleWriter &&) = delete;
+    SampleWriter &operator=(const SampleWriter &) = delete;
+    SampleWriter &operator=(SampleWriter &&) = delete;
+
+    void open(const std::string &file);
+    bool is_open(void) const noexcept { return fd_ >= 0; }
+    void write(const Sample &s);
+    void flush(void);
+};
+
+/**
+ * Reads back a sample dump written by SampleWriter.
+ */
+class SampleReader
+{
+  private:
+    std::ifstream f_;
+    uint64_t last_; /* deadline of the previous record */
+
+  public:
+    explicit SampleReader(const std::string &file);
+    ~SampleReader(void) noexcept {}
+
+    /* No copy or move */
+    SampleReader(const SampleReader &) = delete;
+    SampleReader(SampleReader &&) = delete;
+    SampleReader &operator=(const SampleReader &) = delete;
+    SampleReader &operator=(SampleReader &&) = delete;
+
+    /* Read the next sample, false at end of dump */
+    bool next(Sample &s);
+};
+
+#endif /* MUTATED_SAMPLES_HH */
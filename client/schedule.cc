@@ -0,0 +1,205 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "schedule.hh"
+#include "util.hh"
+
+using namespace std;
+
+/**
+ * Create a new request schedule.
+ * @cfg: the experiment configuration.
+ * @req_s: the request rate of the schedule.
+ * @samples: the number of requests in the measurement phase.
+ * @rand: the random number generator to draw inter-arrival times with.
+ * @replay: a trace of inter-arrival times to replay instead, if not empty.
+ */
+Schedule::Schedule(const Config &cfg, double req_s, uint64_t samples,
+                   mt19937 &&rand, const string &replay)
+  : rand_{move(rand)}
+  , iat_{cfg.arrival_dist, cfg.arrival_shape}
+  , mean_ns_{NSEC / req_s}
+  , share_{req_s / cfg.req_s}
+  , profile_{}
+  , replay_{}
+  , warmup_{chrono::seconds(cfg.warmup_seconds)}
+  , cooldown_{chrono::seconds(cfg.cooldown_seconds)}
+  , samples_{samples}
+  , phase_{WARMUP}
+  , accum_{0}
+  , measurestart_{0}
+  , coolstart_{0}
+  , pos_{0}
+  , pre_samples_{UNKNOWN}
+  , measure_samples_{UNKNOWN}
+  , total_samples_{UNKNOWN}
+  , chunk_{}
+  , base_{0}
+  , iatimes_{}
+{
+    if (cfg.load_profile != nullptr) {
+        profile_.reset(new LoadProfile(cfg.load_profile));
+    }
+    if (not replay.empty()) {
+        replay_.reset(new TraceReader(replay));
+    }
+    chunk_.reserve(SCHEDULE_CHUNK);
+    advance();
+}
+
+/**
+ * Record inter-arrival times to a file as the schedule is generated. Must be
+ * called before the first deadline is accessed.
+ * @file: the file to record to.
+ */
+void Schedule::record(const string &file)
+{
+    if (pos_ != 0) {
+        throw logic_error("Schedule::record: schedule already generated");
+    }
+    iatimes_.open(file);
+}
+
+/**
+ * Start a new schedule from the beginning, at a different request rate and
+ * with a different warm-up. Not supported for replayed schedules or load
+ * profiles, which can't be rescaled.
+ * @req_s: the request rate of the new schedule.
+ * @warmup: the length of the new warm-up phase.
+ */
+void Schedule::restart(double req_s, duration warmup)
+{
+    if (replay_ or profile_) {
+        throw logic_error("Schedule::restart: can't restart a replay or "
+                          "load profile");
+    }
+
+    mean_ns_ = NSEC / req_s;
+    warmup_ = warmup;
+    phase_ = WARMUP;
+    accum_ = 0;
+    measurestart_ = duration(0);
+    coolstart_ = duration(0);
+    pos_ = 0;
+    pre_samples_ = measure_samples_ = total_samples_ = UNKNOWN;
+    chunk_.clear();
+    base_ = 0;
+    advance();
+}
+
+/**
+ * Produce the next inter-arrival time.
+ * @now: the time of the last deadline.
+ * @iat: the inter-arrival time (nanoseconds).
+ * @return: false if the schedule has run out of inter-arrival times.
+ */
+bool Schedule::next_iat(duration now, double &iat)
+{
+    if (replay_) {
+        uint64_t ns;
+        if (not replay_->next(ns)) {
+            return false;
+        }
+        iat = ns;
+    } else {
+        iat = next_mean_ns(now) * iat_(rand_);
+    }
+    return true;
+}
+
+/**
+ * The mean inter-arrival time to use for the next deadline.
+ * @now: the time of the last deadline.
+ */
+double Schedule::next_mean_ns(duration now) const noexcept
+{
+    if (phase_ != MEASURE or not profile_) {
+        return mean_ns_;
+    }
+    double t = (now - measurestart_).count() / NSEC;
+    return NSEC / (profile_->rate(t) * share_);
+}
+
+/**
+ * Move through the phases of the schedule as deadlines are generated.
+ */
+void Schedule::advance(void)
+{
+    duration now = duration(uint64_t(ceil(accum_)));
+
+    if (phase_ == WARMUP and now >= warmup_) {
+        pre_samples_ = pos_;
+        measurestart_ = now;
+        phase_ = MEASURE;
+    }
+
+    if (phase_ == MEASURE) {
+        bool done;
+        if (profile_) {
+            double t = (now - measurestart_).count() / NSEC;
+            done = t >= profile_->duration();
+        } else {
+            done = pos_ - pre_samples_ >= samples_;
+        }
+
+        if (done) {
+            measure_samples_ = pos_ - pre_samples_;
+            coolstart_ = now;
+            phase_ = COOLDOWN;
+        }
+    }
+
+    if (phase_ == COOLDOWN and now - coolstart_ >= cooldown_) {
+        finish();
+    } else if (phase_ != DONE and replay_ and replay_->eof()) {
+        finish();
+    }
+}
+
+/**
+ * End the schedule at the current position, truncating any unfinished phase.
+ */
+void Schedule::finish(void)
+{
+    if (pre_samples_ == UNKNOWN) {
+        pre_samples_ = pos_;
+    }
+    if (measure_samples_ == UNKNOWN) {
+        measure_samples_ = pos_ - pre_samples_;
+    }
+    total_samples_ = pos_;
+    phase_ = DONE;
+    if (iatimes_.is_open()) {
+        iatimes_.close();
+    }
+}
+
+/**
+ * Drop the current chunk of deadlines and generate the next one.
+ */
+void Schedule::refill(void)
+{
+    if (phase_ == DONE) {
+        throw out_of_range("Schedule::refill: past end of schedule");
+    }
+
+    base_ += chunk_.size();
+    chunk_.clear();
+
+    while (chunk_.size() < SCHEDULE_CHUNK and phase_ != DONE) {
+        duration last = duration(uint64_t(ceil(accum_)));
+        double iat;
+        if (not next_iat(last, iat)) {
+            finish();
+            break;
+        }
+        accum_ += iat;
+        duration next = duration(uint64_t(ceil(accum_)));
+        chunk_.push_back(next);
+        if (iatimes_.is_open()) {
+            iatimes_.write((next - last).count());
+        }
+        pos_++;
+        advance();
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef MUTATED_SCHEDULE_HH
+#define MUTATED_SCHEDULE_HH
+
+/**
+ * schedule.hh - the request schedule of an experiment. Deadlines are
+ * generated lazily, a small chunk at a time ahead of the sender, so memory use
+ * and startup time are independent of the length of the experiment.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "interarrival.hh"
+#include "limits.hh"
+#include "opts.hh"
+#include "profile.hh"
+#include "trace.hh"
+
+/**
+ * A request schedule made of warm-up, measurement and cool-down phases. The
+ * length of the warm-up and cool-down phases is fixed in time, while the
+ * measurement phase is fixed in requests, or in time when following a load
+ * profile. Deadlines are relative to the start of the experiment and can only
+ * be accessed in increasing order.
+ *
+ * The size of each phase is only known once the schedule has been generated
+ * past it, until then it is reported as `UNKNOWN`.
+ *
+ * Inter-arrival times are either drawn from a distribution or replayed from a
+ * trace, in which case the schedule ends early if the trace runs out.
+ */
+class Schedule
+{
+  public:
+    using duration = std::chrono::nanoseconds;
+
+    static constexpr uint64_t UNKNOWN = std::numeric_limits<uint64_t>::max();
+
+  private:
+    enum phases {
+        WARMUP,
+        MEASURE,
+        COOLDOWN,
+        DONE,
+    };
+
+    std::mt19937 rand_;
+    InterArrival iat_;
+    double mean_ns_;
+    const double share_; /* our share of the load profile's rate */
+    std::unique_ptr<LoadProfile> profile_;
+    std::unique_ptr<TraceReader> replay_; /* replayed inter-arrival times */
+    duration warmup_;
+    const duration cooldown_;
+    const uint64_t samples_;
+
+    phases phase_;
+    double accum_;
+    duration measurestart_;
+    duration coolstart_;
+    uint64_t pos_;
+    uint64_t pre_samples_, measure_samples_, total_samples_;
+
+    std::vector<duration> chunk_; /* deadlines generated ahead of the sender */
+    uint64_t base_;               /* position of chunk_[0] in the schedule */
+
+    TraceWriter iatimes_; /* record inter-arrival times as generated */
+
+    double next_mean_ns(duration now) const noexcept;
+    bool next_iat(duration now, double &iat);
+    void advance(void);
+    void finish(void);
+    void refill(void);
+
+  public:
+    Schedule(const Config &cfg, double req_s, uint64_t samples,
+             std::mt19937 &&rand, const std::string &replay = "");
+    ~Schedule(void) noexcept {}
+
+    /* No copy or move */
+    Schedule(const Schedule &) = delete;
+    Schedule(Schedule &&) = delete;
+    Schedule &operator=(const Schedule &) = delete;
+    Schedule &operator=(Schedule &&) = delete;
+
+    /* Record inter-arrival times to a file as they're generated */
+    void record(const std::string &file);
+
+    /* Start over with a new rate and warm-up, e.g., for the next load step */
+    void restart(double req_s, duration warmup);
+
+    /* The deadline of the i'th request */
+    duration deadline(uint64_t i)
+    {
+        if (i - base_ >= chunk_.size()) {
+            refill();
+        }
+        return chunk_[i - base_];
+    }
+
+    /* The load profile followed by the measurement phase, if any */
+    const LoadProfile *profile(void) const noexcept { return profile_.get(); }
+
+    /* Start of the measurement phase, only valid once it's reached */
+    duration measure_start(void) const noexcept { return measurestart_; }
+
+    /* Number of warm-up requests */
+    uint64_t pre_samples(void) const noexcept { return pre_samples_; }
+
+    /* Number of measurement requests */
+    uint64_t measure_samples(void) const noexcept { return measure_samples_; }
+
+    /* Total number of requests */
+    uint64_t total_samples(void) const noexcept { return total_samples_; }
+};
+
+#endif /* MUTATED_SCHEDULE_HH */
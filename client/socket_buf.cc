@@ -7,9 +7,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <sys/uio.h>
 #include <unistd.h>
 
 #include "linux_compat.hh"
@@ -18,6 +18,53 @@
 
 using namespace std;
 
+/**
+ * SharedBuf - copy data into a new, sealed, memory file.
+ * @data: the data.
+ * @size: its size.
+ */
+SharedBuf::SharedBuf(const void *data, size_t size)
+  : fd_{-1}, data_{nullptr}, size_{size}
+{
+    fd_ = system_call(memfd_create("mutated-shared",
+                                   MFD_CLOEXEC | MFD_ALLOW_SEALING),
+                      "SharedBuf::SharedBuf: memfd_create()");
+    system_call(ftruncate(fd_, size_), "SharedBuf::SharedBuf: ftruncate()");
+
+    // fill it through a writable mapping, then seal it and map it read-only
+    void *p =
+      mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        throw system_error(errno, system_category(),
+                           "SharedBuf::SharedBuf: mmap()");
+    }
+    memcpy(p, data, size_);
+    munmap(p, size_);
+    system_call(fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+                                          F_SEAL_WRITE | F_SEAL_SEAL),
+                "SharedBuf::SharedBuf: fcntl(F_ADD_SEALS)");
+
+    p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        throw system_error(errno, system_category(),
+                           "SharedBuf::SharedBuf: mmap(PROT_READ)");
+    }
+    data_ = static_cast<char *>(p);
+}
+
+/**
+ * ~SharedBuf - unmap and close the memory file.
+ */
+SharedBuf::~SharedBuf(void) noexcept
+{
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
 /**
  * Sock - construct a new socket.
  */
@@ -29,7 +76,18 @@ Sock::Sock(void) noexcept : fd_{-1},
                             rbuf_{},
                             tx_cbs_{},
                             wbuf_{},
-                            tx_out_{0}
+                            tx_out_{0},
+                            tx_shared_{},
+                            shared_bytes_{0},
+                            shared_ahead_{0},
+                            stamp_{false},
+                            io_ts_{},
+                            ring_{nullptr},
+                            ring_id_{0},
+                            tx_busy_{false},
+                            tx_busy_shared_{false},
+                            unflushed_{nullptr},
+                            flush_pending_{false}
 {
 }
 
@@ -41,10 +99,10 @@ Sock::~Sock(void) noexcept
     // cancel all pending read requests
     for (auto &rxcb : rx_cbs_) {
         if (rxcb.hdrcb) {
-            rxcb.hdrcb(this, rxcb.cbdata, nullptr, 0, nullptr, 0, -EIO);
+            rxcb.hdrcb(this, rxcb.cbdata, nullptr, 0, -EIO);
         }
         if (rxcb.bodycb) {
-            rxcb.bodycb(this, rxcb.cbdata, nullptr, 0, nullptr, 0, -EIO);
+            rxcb.bodycb(this, rxcb.cbdata, nullptr, 0, -EIO);
         }
     }
 
@@ -55,6 +113,29 @@ Sock::~Sock(void) noexcept
         }
     }
 
+    // nobody's left to flush us
+    if (flush_pending_) {
+        unflushed_->erase(
+          remove(unflushed_->begin(), unflushed_->end(), this),
+          unflushed_->end());
+    }
+
+    // stop our ring operations, ignoring any completions still to come (an
+    // in-flight send may still read the pinned tx buffer, so the ring keeps
+    // that until the send completes)
+    if (ring_ != nullptr) {
+        uint64_t cookie = Uring::cookie(ring_id_, Uring::SEND);
+        ring_->cancel(Uring::cookie(ring_id_, Uring::RECV));
+        if (tx_busy_) {
+            ring_->cancel(cookie);
+            size_t cap;
+            if (char *block = wbuf_.disown(cap)) {
+                ring_->park(cookie, block, cap);
+            }
+        }
+        ring_->detach(ring_id_);
+    }
+
     // we don't check for any errors since difficult to handle in a
     // deconstructor
     if (fd_ >= 0) {
@@ -81,6 +162,9 @@ Sock::~Sock(void) noexcept
     rx_cbs_.clear();
     tx_cbs_.clear();
     tx_out_ = 0;
+    tx_shared_.clear();
+    shared_bytes_ = 0;
+    shared_ahead_ = 0;
 }
 
 /**
@@ -134,81 +218,83 @@ void Sock::rx(void)
             return;
         }
 
-        // do the read
+        // do the read, into whatever room the buffer has, growing it when
+        // full of a partial response
         ssize_t nbytes;
-        size_t n = rbuf_.space(), n1 = n;
-        auto rptrs = rbuf_.queue_prep(n1);
-        if (rptrs.second == nullptr) {
-            // no wrapping, normal read
-            nbytes = ::read(fd_, rptrs.first, n);
-        } else {
-            // need to wrap, so use writev
-            iovec iov[2];
-            iov[0].iov_base = rptrs.first;
-            iov[0].iov_len = n1;
-            iov[1].iov_base = rptrs.second;
-            iov[1].iov_len = n - n1;
-            nbytes = ::readv(fd_, iov, 2);
+        if (rbuf_.room() == 0) {
+            rbuf_.reserve(1);
         }
+        size_t n = rbuf_.room();
+        nbytes = ::read(fd_, rbuf_.queue_prep(n), n);
 
         if (nbytes < 0 and errno == EAGAIN) {
             rx_rdy_ = false;
             return;
         } else if (nbytes <= 0) {
             throw system_error(errno, system_category(),
-                               "Sock::rx: readv error");
+                               "Sock::rx: read error");
         } else if (size_t(nbytes) > n) {
             throw runtime_error(
               "Sock::rx: read returned more bytes than asked");
         }
         rbuf_.queue_commit(nbytes);
+        if (stamp_) {
+            io_ts_ = Clock::now();
+        }
+        rx_process();
+    }
+}
 
-        size_t drop = 0;
-        for (auto &rxcb : rx_cbs_) {
-            if (rxcb.hdrlen > 0) {
-                if (rbuf_.items() < rxcb.hdrlen) {
-                    if (!rxcb.hdrcb) { // partial drop when no cb
-                        size_t n = rbuf_.items();
-                        rxcb.hdrlen -= n;
-                        rbuf_.drop(n);
-                    }
-                    break;
-                }
-                if (rxcb.hdrcb) {
-                    n = n1 = rxcb.hdrlen;
-                    rptrs = rbuf_.peek(n1);
-                    // parse header and set body length from it
-                    rxcb.bodylen = rxcb.hdrcb(this, rxcb.cbdata, rptrs.first,
-                                              n1, rptrs.second, n - n1, 0);
+/**
+ * rx_process - complete the pending reads that the received data covers.
+ */
+void Sock::rx_process(void)
+{
+    size_t drop = 0;
+    for (auto &rxcb : rx_cbs_) {
+        if (rxcb.hdrlen > 0) {
+            if (rbuf_.items() < rxcb.hdrlen) {
+                if (!rxcb.hdrcb) { // partial drop when no cb
+                    size_t n = rbuf_.items();
+                    rxcb.hdrlen -= n;
+                    rbuf_.drop(n);
                 }
-                rbuf_.drop(rxcb.hdrlen);
-                rxcb.hdrlen = 0; // mark header done
+                break;
+            }
+            if (rxcb.hdrcb) {
+                // parse header (in place) and set body length from it
+                rxcb.bodylen =
+                  rxcb.hdrcb(this, rxcb.cbdata, rbuf_.peek(rxcb.hdrlen),
+                             rxcb.hdrlen, 0);
             }
+            rbuf_.drop(rxcb.hdrlen);
+            rxcb.hdrlen = 0; // mark header done
+        }
 
-            if (rxcb.bodylen > 0) {
-                if (rbuf_.items() < rxcb.bodylen) {
-                    if (!rxcb.bodycb) { // partial drop when no cb
-                        size_t n = rbuf_.items();
-                        rxcb.bodylen -= n;
-                        rbuf_.drop(n);
-                    }
-                    break;
-                }
-                if (rxcb.bodycb) {
-                    n = n1 = rxcb.bodylen;
-                    rptrs = rbuf_.peek(n1);
-                    rxcb.bodycb(this, rxcb.cbdata, rptrs.first, n1,
-                                rptrs.second, n - n1, 0);
+        if (rxcb.bodylen > 0) {
+            if (rbuf_.items() < rxcb.bodylen) {
+                if (!rxcb.bodycb) { // partial drop when no cb
+                    size_t n = rbuf_.items();
+                    rxcb.bodylen -= n;
+                    rbuf_.drop(n);
                 }
-                rbuf_.drop(rxcb.bodylen);
-                rxcb.bodylen = 0; // mark body done
+                break;
             }
-
-            drop++;
+            if (rxcb.bodycb) {
+                rxcb.bodycb(this, rxcb.cbdata, rbuf_.peek(rxcb.bodylen),
+                            rxcb.bodylen, 0);
+            }
+            rbuf_.drop(rxcb.bodylen);
+            rxcb.bodylen = 0; // mark body done
         }
 
-        // drop done packets
-        rx_cbs_.drop(drop);
+        drop++;
+    }
+
+    // drop done packets, and the memory of a burst of them
+    rx_cbs_.drop(drop);
+    if (rbuf_.items() == 0) {
+        rbuf_.shrink();
     }
 }
 
@@ -220,7 +306,11 @@ void Sock::read(const IORx &op)
 {
     size_t n = 1;
     *rx_cbs_.queue(n) = op;
-    if (rx_rdy_) {
+    if (ring_ != nullptr) {
+        if (rbuf_.items() > 0) {
+            rx_process();
+        }
+    } else if (rx_rdy_) {
         rx();
     }
 }
@@ -231,26 +321,25 @@ void Sock::read(const IORx &op)
 void Sock::tx(void)
 {
     while (true) {
-        // is anything pending for send?
-        if (wbuf_.items() == 0) {
-            return;
-        }
-
+        size_t n;
         ssize_t nbytes;
-        size_t n = wbuf_.items(), n1 = n;
-        auto wptrs = wbuf_.peek(n1);
-
-        if (wptrs.second == nullptr) {
-            // no wrapping, normal write
-            nbytes = ::write(fd_, wptrs.first, n);
+        bool shared = tx_shared_.items() > 0 and tx_shared_.at(0).before == 0;
+
+        if (shared) {
+            // a shared span: the kernel sends straight from its file
+            const TxShared &span = tx_shared_.at(0);
+            off_t off = span.off;
+            n = span.len;
+            nbytes = sendfile(fd_, span.buf->fd(), &off, n);
+        } else if (wbuf_.items() == 0) {
+            return; // nothing pending for send
+        } else if (tx_shared_.items() > 0) {
+            // the tx buffer up to a shared span, to be sent with it
+            n = tx_shared_.at(0).before;
+            nbytes = ::send(fd_, wbuf_.peek(n), n, MSG_MORE);
         } else {
-            // need to wrap, so use writev
-            iovec iov[2];
-            iov[0].iov_base = wptrs.first;
-            iov[0].iov_len = n1;
-            iov[1].iov_base = wptrs.second;
-            iov[1].iov_len = n - n1;
-            nbytes = ::writev(fd_, iov, 2);
+            n = wbuf_.items();
+            nbytes = ::write(fd_, wbuf_.peek(n), n);
         }
 
         if (nbytes < 0) {
@@ -264,39 +353,62 @@ void Sock::tx(void)
         } else if (size_t(nbytes) > n) {
             throw runtime_error("Sock::tx: write sent more bytes than asked");
         }
-        wbuf_.drop(nbytes);
-
-        // update tx callbacks
-        size_t drop = 0;
-        for (auto &txcb : tx_cbs_) {
-            if (txcb.len > size_t(nbytes)) {
-                txcb.len -= nbytes;
-                tx_out_ -= nbytes;
-                break;
-            } else {
-                txcb.cb(this, txcb.cbdata, 0);
-                nbytes -= txcb.len;
-                tx_out_ -= txcb.len;
-                drop++;
-            }
+        if (stamp_) {
+            io_ts_ = Clock::now();
         }
-        tx_cbs_.drop(drop);
+        tx_sent(nbytes, shared);
     }
 }
 
 /**
- * Prepare a write on this socket.
- * @len: the size of the requested write. The available buffer through the
- * first pointer is returned through len.
- * @return: the buffer, split between two contiguous segments, for the write.
- * The length of the first segment is returned through len, the length of the
- * second segment is the remaining needed buffer to fullfill the request.
+ * tx_sent - drop sent data and complete the writes it covers.
+ * @bytes: the number of bytes sent.
+ * @shared: were they of the first shared span, not of the tx buffer?
  */
-pair<char *, char *> Sock::write_prepare(size_t &len)
+void Sock::tx_sent(size_t bytes, bool shared)
 {
-    return wbuf_.queue_prep(len);
+    if (shared) {
+        TxShared &span = tx_shared_.at(0);
+        span.off += bytes;
+        span.len -= bytes;
+        shared_bytes_ -= bytes;
+        if (span.len == 0) {
+            tx_shared_.drop(1);
+        }
+    } else {
+        wbuf_.drop(bytes);
+        if (wbuf_.items() == 0) {
+            wbuf_.shrink();
+        }
+        if (tx_shared_.items() > 0) {
+            tx_shared_.at(0).before -= bytes;
+            shared_ahead_ -= bytes;
+        }
+    }
+
+    size_t drop = 0;
+    for (auto &txcb : tx_cbs_) {
+        if (txcb.len > bytes) {
+            txcb.len -= bytes;
+            tx_out_ -= bytes;
+            break;
+        } else {
+            txcb.cb(this, txcb.cbdata, 0);
+            bytes -= txcb.len;
+            tx_out_ -= txcb.len;
+            drop++;
+        }
+    }
+    tx_cbs_.drop(drop);
 }
 
+/**
+ * Prepare a write on this socket.
+ * @len: the size of the requested write.
+ * @return: the (contiguous) buffer for the write.
+ */
+char *Sock::write_prepare(size_t len) { return wbuf_.queue_prep(len); }
+
 /**
  * Commit a previously prepared write on this socket, making it available for
  * transmission.
@@ -311,16 +423,32 @@ void Sock::write_commit(const size_t len) { wbuf_.queue_commit(len); }
  */
 void Sock::write(const void *data, const size_t len)
 {
-    const char *p = reinterpret_cast<const char *>(data);
-    size_t n1 = len;
-    auto wptrs = write_prepare(n1);
-    memcpy(wptrs.first, p, n1);
-    if (n1 != len) {
-        memcpy(wptrs.second, p + n1, len - n1);
-    }
+    memcpy(write_prepare(len), data, len);
     write_commit(len);
 }
 
+/**
+ * Queue len bytes of a shared buffer for transmission, after all data
+ * written so far, without copying them: the buffer must outlive the socket.
+ * @buf: the shared buffer.
+ * @off: the offset in the buffer of the data.
+ * @len: length of the data.
+ */
+void Sock::write_shared(const SharedBuf &buf, size_t off, size_t len)
+{
+    if (off + len > buf.size()) {
+        throw out_of_range("Sock::write_shared: beyond end of buffer");
+    } else if (len == 0) {
+        return;
+    }
+
+    // the tx buffer data not already ahead of an earlier span goes first
+    size_t before = wbuf_.items() - shared_ahead_;
+    tx_shared_.queue_emplace(TxShared{before, &buf, off, len});
+    shared_ahead_ = wbuf_.items();
+    shared_bytes_ += len;
+}
+
 /**
  * Insert a write callback to fire once all data previously inserted into the
  * queue has been sent. You should insert a callback point _before_ calling
@@ -332,7 +460,7 @@ void Sock::write_cb_point(const IOTx::CB cb, void *data)
 {
     // we want to store CB's by bytes needing to be sent as a delta from the
     // earlier CB as it makes firing them more efficient.
-    size_t len = wbuf_.items();
+    size_t len = wbuf_.items() + shared_bytes_;
     if (tx_cbs_.items() == 0) {
         tx_cbs_.queue_emplace(len, cb, data);
     } else {
@@ -342,13 +470,51 @@ void Sock::write_cb_point(const IOTx::CB cb, void *data)
 }
 
 /**
- * Commit a previously prepared write on this socket, making it available for
- * transmission.
- * @len: the length of previously prepared write to commit.
+ * Attempt to transmit queued data if the socket is ready, unless corked, in
+ * which case queue the socket to be flushed (once) instead.
  */
 void Sock::try_tx(void)
 {
-    if (tx_rdy_) {
+    if (unflushed_ == nullptr) {
+        flush();
+    } else if (not flush_pending_) {
+        flush_pending_ = true;
+        unflushed_->push_back(this);
+    }
+}
+
+/**
+ * Attempt to transmit queued data if the socket is ready, corked or not.
+ */
+void Sock::flush(void)
+{
+    flush_pending_ = false;
+    if (ring_ != nullptr) {
+        // one send at a time: of a shared span (zero-copy), or of all the
+        // tx buffer up to the next span, from the pinned buffer
+        uint64_t cookie = Uring::cookie(ring_id_, Uring::SEND);
+        if (tx_busy_) {
+            return;
+        } else if (tx_shared_.items() > 0 and tx_shared_.at(0).before == 0) {
+            const TxShared &span = tx_shared_.at(0);
+            ring_->send_zc(fd_, span.buf->data() + span.off, span.len,
+                           cookie);
+            tx_busy_shared_ = true;
+        } else if (wbuf_.items() > 0) {
+            size_t n = wbuf_.items();
+            int flags = 0;
+            if (tx_shared_.items() > 0) {
+                n = tx_shared_.at(0).before;
+                flags = MSG_MORE;
+            }
+            ring_->send(fd_, wbuf_.peek(n), n, cookie, flags);
+            wbuf_.pin();
+            tx_busy_shared_ = false;
+        } else {
+            return;
+        }
+        tx_busy_ = true;
+    } else if (tx_rdy_) {
         tx();
     }
 }
@@ -392,3 +558,63 @@ void Sock::run_io(uint32_t events)
         tx();
     }
 }
+
+/**
+ * use_ring - do all further IO on an io_uring, arming a multishot receive.
+ * The kernel waits for the connection to complete before sending or
+ * receiving, so this may be called right after `connect`.
+ * @ring: the io_uring of the socket's event loop.
+ * @owner: what the ring's completions for the socket go to.
+ */
+void Sock::use_ring(Uring *ring, void *owner)
+{
+    ring_ = ring;
+    ring_id_ = ring_->attach(owner);
+    ring_->recv(fd_, Uring::cookie(ring_id_, Uring::RECV));
+    flush();
+}
+
+/**
+ * complete - handle an io_uring completion against the socket.
+ * @ev: the completion, of one of our receives or sends.
+ */
+void Sock::complete(const Uring::Event &ev)
+{
+    if (Uring::cookie_kind(ev.cookie) == Uring::RECV) {
+        if (ev.res == -ENOBUFS) {
+            // out of receive buffers, retry once they're given back
+            ring_->recv(fd_, Uring::cookie(ring_id_, Uring::RECV));
+            return;
+        } else if (ev.res <= 0) {
+            throw system_error(-ev.res, system_category(),
+                               "Sock::complete: recv error");
+        }
+
+        // copy out of the ring's buffer, which is only lent to us
+        size_t n = ev.res;
+        memcpy(rbuf_.queue_prep(n), ev.buf, n);
+        rbuf_.queue_commit(n);
+        if (stamp_) {
+            io_ts_ = Clock::now();
+        }
+        if (not ev.more) {
+            ring_->recv(fd_, Uring::cookie(ring_id_, Uring::RECV));
+        }
+        rx_process();
+    } else {
+        if (ev.res < 0) {
+            throw system_error(-ev.res, system_category(),
+                               "Sock::complete: send error");
+        }
+
+        tx_busy_ = false;
+        if (not tx_busy_shared_) {
+            wbuf_.unpin();
+        }
+        if (stamp_) {
+            io_ts_ = Clock::now();
+        }
+        tx_sent(ev.res, tx_busy_shared_);
+        flush();
+    }
+}
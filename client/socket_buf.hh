@@ -6,25 +6,51 @@
  * buffers internally for memory management of the rx and tx queues.
  */
 
-// XXX: If we allocate a Socket on the stack it segfaults due to the buffer
-// sizes.
-
 #include <cstdint>
 #include <cstring>
 #include <functional>
 #include <utility>
+#include <vector>
 
 #include "buffer.hh"
+#include "clock.hh"
 #include "limits.hh"
+#include "uring.hh"
 
 class Sock;
 
+/**
+ * Immutable data that sockets can transmit without copying it (see
+ * `Sock::write_shared`), such as values of large requests. Held in a sealed
+ * memory file, which the kernel sends from directly.
+ */
+class SharedBuf
+{
+  private:
+    int fd_;
+    char *data_;
+    std::size_t size_;
+
+  public:
+    SharedBuf(const void *data, std::size_t size);
+    ~SharedBuf(void) noexcept;
+
+    /* No copy or move */
+    SharedBuf(const SharedBuf &) = delete;
+    SharedBuf(SharedBuf &&) = delete;
+    SharedBuf &operator=(const SharedBuf &) = delete;
+    SharedBuf &operator=(SharedBuf &&) = delete;
+
+    int fd(void) const noexcept { return fd_; }
+    const char *data(void) const noexcept { return data_; }
+    std::size_t size(void) const noexcept { return size_; }
+};
+
 /**
  * A RX IO operation.
  */
 struct IORx {
-    using CB = std::function<size_t(Sock *, void *, char *, size_t, char *,
-                                    size_t, int)>;
+    using CB = std::function<size_t(Sock *, void *, char *, size_t, int)>;
 
     size_t hdrlen;
     CB hdrcb;
@@ -79,17 +105,30 @@ struct IOTx {
 
 /**
  * Asynchronous socket (TCP only). Uses circular buffers internally for
- * managing rx and tx queues.
+ * managing rx and tx queues. IO is driven either by epoll events (`run_io`),
+ * or by io_uring completions (`use_ring` and `complete`), where a multishot
+ * receive stays armed and at most one send is in flight.
  *
  * NOTE: write operations (write_commit, write, write_emplace) should be
  * followed by a try_tx to try sending the data if the socket is ready. Write
- * operations place data on the tx buffer but don't attempt to transmit.
+ * operations place data on the tx buffer but don't attempt to transmit. A
+ * corked socket defers even try_tx, until its owner calls `flush`.
  */
 class Sock
 {
   private:
-    using rxqueue = buffer<IORx, MAX_OUTSTANDING_REQS>;
-    using txqueue = buffer<IOTx, MAX_OUTSTANDING_REQS>;
+    using rxqueue = block_queue<IORx, MAX_OUTSTANDING_REQS>;
+    using txqueue = block_queue<IOTx, MAX_OUTSTANDING_REQS>;
+
+    /* A span of a shared buffer to transmit, once `before` more bytes of the
+     * tx buffer have been */
+    struct TxShared {
+        std::size_t before;
+        const SharedBuf *buf;
+        std::size_t off;
+        std::size_t len;
+    };
+    using sharedqueue = block_queue<TxShared, MAX_OUTSTANDING_REQS>;
 
     int fd_;         /* the file descriptor */
     bool connected_; /* is the socket connected? */
@@ -103,8 +142,25 @@ class Sock
     charbuf wbuf_;   /* write buffer */
     size_t tx_out_;  /* total tx data waiting to be sent in txcbs queue */
 
-    void rx(void); /* receive handler */
-    void tx(void); /* transmit handler */
+    sharedqueue tx_shared_; /* shared spans, interleaved with the tx buffer */
+    size_t shared_bytes_;   /* total data of the shared spans */
+    size_t shared_ahead_;   /* tx buffer data ahead of the last span */
+
+    bool stamp_;                /* timestamp every read/write syscall? */
+    Clock::time_point io_ts_;   /* when the last read/write returned */
+
+    Uring *ring_;      /* io_uring doing our IO (or null for epoll) */
+    uint64_t ring_id_; /* our id on the ring */
+    bool tx_busy_;     /* is a send in flight on the ring? */
+    bool tx_busy_shared_; /* is it of a shared span? */
+
+    std::vector<Sock *> *unflushed_; /* where corked sockets wait (or null) */
+    bool flush_pending_;             /* are we waiting there? */
+
+    void rx(void);                   /* receive handler */
+    void rx_process(void);           /* run callbacks of received data */
+    void tx(void);                   /* transmit handler */
+    void tx_sent(std::size_t bytes, bool shared); /* run callbacks of sent */
 
   public:
     Sock(void) noexcept;
@@ -119,6 +175,17 @@ class Sock
     /* Access underlying file descriptor */
     int fd(void) const noexcept { return fd_; }
 
+    /* Take one timestamp per read/write syscall, for all the callbacks it
+     * completes, rather than leaving callbacks to read the clock */
+    void batch_timestamps(bool on) noexcept { stamp_ = on; }
+
+    /* The time the IO completing the current callback happened at: the
+     * timestamp of its syscall if batching timestamps, otherwise now */
+    Clock::time_point io_time(void) const noexcept
+    {
+        return stamp_ ? io_ts_ : Clock::now();
+    }
+
     /* Open a new remote connection */
     void connect(const char *addr, unsigned short port);
 
@@ -126,26 +193,21 @@ class Sock
     void read(const IORx &io);
 
     /* Write queueing preparation */
-    std::pair<char *, char *> write_prepare(size_t &len);
+    char *write_prepare(size_t len);
     void write_commit(const size_t len);
 
     /* Write */
     void write(const void *data, const size_t len);
 
+    /* Write part of a shared buffer, which is transmitted without copying */
+    void write_shared(const SharedBuf &buf, size_t off, size_t len);
+
     /* Write by constructing in-place */
     template <class T, class... Args> void write_emplace(Args &&... args)
     {
-        std::size_t n = sizeof(T), n1 = n;
-        auto p = write_prepare(n1);
-        if (p.second == nullptr) {
-            ::new (static_cast<void *>(p.first))
-              T(std::forward<Args>(args)...);
-        } else {
-            T t(std::forward<Args>(args)...);
-            memcpy(p.first, &t, n1);
-            memcpy(p.second, &t + n1, n - n1);
-        }
-        write_commit(n);
+        ::new (static_cast<void *>(write_prepare(sizeof(T))))
+          T(std::forward<Args>(args)...);
+        write_commit(sizeof(T));
     }
 
     /* Insert a write callback to fire once all data previously inserted into
@@ -153,11 +215,29 @@ class Sock
      * calling `try_tx()` ideally. */
     void write_cb_point(const IOTx::CB cb, void *data);
 
-    /* Attempt to transmit data if the socket is ready */
+    /* Attempt to transmit data if the socket is ready, or if corked, leave
+     * it for `flush` */
     void try_tx(void);
 
+    /* Cork the socket: try_tx adds us to unflushed (once) for the owner of
+     * the list to flush later, so that writes batch into fewer syscalls */
+    void cork(std::vector<Sock *> *unflushed) noexcept
+    {
+        unflushed_ = unflushed;
+    }
+
+    /* Attempt to transmit data if the socket is ready, even if corked */
+    void flush(void);
+
     /* Handle epoll events against this socket */
     void run_io(uint32_t events);
+
+    /* Do IO through an io_uring rather than epoll, with completions going
+     * to owner (who passes them to `complete`) */
+    void use_ring(Uring *ring, void *owner);
+
+    /* Handle an io_uring completion against this socket */
+    void complete(const Uring::Event &ev);
 };
 
 #endif /* MUTATED_SOCKET_BUF_HH */
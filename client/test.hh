@@ -0,0 +1,68 @@
+#ifndef MUTATED_TEST_HH
+#define MUTATED_TEST_HH
+
+/**
+ * test.hh - a minimal harness for the unit tests run by `make check`. Each
+ * test is a program that runs its checks and exits with `test_status()`.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+/* Number of checks failed so far */
+static unsigned int test_failures = 0;
+
+/* Check a condition, reporting it (and carrying on) if it doesn't hold */
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (not(cond)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: "     \
+                      << #cond << std::endl;                                   \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+/* Check that an expression throws an exception of a type */
+#define CHECK_THROWS(expr, type)                                               \
+    do {                                                                       \
+        bool thrown = false;                                                   \
+        try {                                                                  \
+            (void)(expr);                                                      \
+        } catch (const type &) {                                               \
+            thrown = true;                                                     \
+        }                                                                      \
+        if (not thrown) {                                                      \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": didn't throw: "     \
+                      << #expr << std::endl;                                   \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+/* The name of a new, empty, temporary file (with a suffix), for the test to
+ * remove once done with it */
+inline std::string temp_file(const std::string &suffix = "")
+{
+    std::string name = "/tmp/mutated-test-XXXXXX" + suffix;
+    int fd = mkstemps(&name[0], suffix.size());
+    if (fd < 0) {
+        std::cerr << "temp_file: mkstemps() failed" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return name;
+}
+
+/* Exit status of a test program: failure if any check failed */
+inline int test_status(void)
+{
+    if (test_failures > 0) {
+        std::cerr << test_failures << " check(s) failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+#endif /* MUTATED_TEST_HH */
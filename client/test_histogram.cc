@@ -0,0 +1,160 @@
+/**
+ * test_histogram.cc - unit tests of Histogram bucketing, merging and
+ * serialization.
+ */
+
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "accum.hh"
+#include "histogram.hh"
+#include "test.hh"
+
+using namespace std;
+
+/* Values are reported within a relative error of 2^-precision */
+static bool within(uint64_t reported, uint64_t val, unsigned int precision)
+{
+    return reported >= val and reported - val <= (val >> precision);
+}
+
+/* Small values are counted exactly */
+static void test_exact(void)
+{
+    Histogram h(5);
+    for (uint64_t v = 0; v < 32; v++) {
+        h.add_sample(v);
+    }
+    CHECK(h.size() == 32);
+    CHECK(h.min() == 0);
+    CHECK(h.max() == 31);
+    CHECK(h.mean() == 15.5);
+    CHECK(h.percentile(0.5) == 15);
+    CHECK(h.percentile(0.99) == 31);
+    CHECK(h.percentile(0) == 0);
+    CHECK(h.count_above(20) == 11);
+}
+
+/* Large values land in buckets within the precision */
+static void test_buckets(void)
+{
+    for (unsigned int precision : {0u, 3u, 5u, 10u}) {
+        for (uint64_t v = 1; v < (uint64_t(1) << 62); v = v * 3 / 2 + 1) {
+            // a larger second sample, so the first isn't clamped to the max
+            Histogram h(precision);
+            h.add_sample(v);
+            h.add_sample(2 * v + 2);
+            CHECK(within(h.percentile(0.5), v, precision));
+            CHECK(h.count_above(v) == 1);
+        }
+    }
+
+    // the largest values still get a bucket
+    Histogram h(5);
+    h.add_sample(UINT64_MAX);
+    CHECK(h.percentile(0.5) == UINT64_MAX);
+    CHECK(h.max() == UINT64_MAX);
+}
+
+/* Merging gives the histogram of all samples */
+static void test_merge(void)
+{
+    mt19937 rand(1);
+    lognormal_distribution<double> dist(8, 1.5);
+    Histogram all(5), a(5), b(5), empty(5);
+    for (unsigned int i = 0; i < 10000; i++) {
+        uint64_t v = dist(rand);
+        all.add_sample(v);
+        (i % 3 ? a : b).add_sample(v);
+    }
+
+    a.merge(b);
+    a.merge(empty);
+    CHECK(a.size() == all.size());
+    CHECK(a.min() == all.min());
+    CHECK(a.max() == all.max());
+    CHECK(a.mean() == all.mean());
+    for (double p : {0.01, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+        CHECK(a.percentile(p) == all.percentile(p));
+    }
+
+    // merging into an empty histogram copies it
+    empty.merge(all);
+    CHECK(empty.size() == all.size());
+    CHECK(empty.min() == all.min());
+    CHECK(empty.percentile(0.99) == all.percentile(0.99));
+
+    // a coarser histogram is re-bucketed at our precision
+    Histogram coarse(3), fine(8);
+    vector<uint64_t> vals = {100, 1000, 10000, 100000};
+    for (uint64_t v : vals) {
+        coarse.add_sample(v);
+    }
+    fine.merge(coarse);
+    CHECK(fine.size() == vals.size());
+    CHECK(fine.min() == vals.front());
+    CHECK(fine.max() == vals.back());
+    CHECK(within(fine.percentile(0.5), 1000, 3));
+}
+
+/* Serialized histograms read back the same */
+static void test_serialize(void)
+{
+    Histogram h(7), r;
+    for (uint64_t v = 1; v < 1000000; v = v * 7 / 5 + 1) {
+        h.add_sample(v);
+    }
+
+    stringstream ss;
+    h.write(ss);
+    r.read(ss);
+    CHECK(r.precision() == 7);
+    CHECK(r.size() == h.size());
+    CHECK(r.min() == h.min());
+    CHECK(r.max() == h.max());
+    CHECK(r.mean() == h.mean());
+    CHECK(r.stddev() == h.stddev());
+    for (double p : {0.1, 0.5, 0.99}) {
+        CHECK(r.percentile(p) == h.percentile(p));
+    }
+
+    stringstream bad("MUTHST99");
+    CHECK_THROWS(r.read(bad), runtime_error);
+    stringstream cut(ss.str().substr(0, 12));
+    CHECK_THROWS(r.read(cut), runtime_error);
+}
+
+/* Accumulators keeping samples take on the precision of a histogram they
+ * merge, rather than degrading it */
+static void test_accum(void)
+{
+    Accum raw(16), fine(16, 10);
+    raw.add_sample(100000);
+    fine.add_sample(1000001);
+    fine.add_sample(2000001);
+    raw.merge(fine);
+    Histogram h = raw.histogram();
+    CHECK(h.precision() == 10);
+    CHECK(h.size() == 3);
+    CHECK(within(h.percentile(0.5), 1000001, 10));
+
+    // and those keeping a histogram bucket merged samples at theirs
+    Accum coarse(16, 3), samples(16);
+    samples.add_sample(1000001);
+    samples.add_sample(2000001);
+    coarse.merge(samples);
+    CHECK(coarse.histogram().precision() == 3);
+    CHECK(within(coarse.histogram().percentile(0.5), 1000001, 3));
+}
+
+int main(void)
+{
+    test_exact();
+    test_buckets();
+    test_merge();
+    test_serialize();
+    test_accum();
+    return test_status();
+}
@@ -0,0 +1,180 @@
+/**
+ * test_profile.cc - unit tests of parsing load profiles (LoadProfile) and
+ * inter-arrival time traces (TraceReader).
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include "profile.hh"
+#include "test.hh"
+#include "trace.hh"
+
+using namespace std;
+
+static bool near(double a, double b) { return fabs(a - b) < 1e-6; }
+
+static void test_ramp(void)
+{
+    LoadProfile p("ramp:100:200:4");
+    CHECK(p.segments().size() == 4);
+    CHECK(near(p.duration(), 4));
+    CHECK(near(p.mean_rate(), 150));
+    CHECK(near(p.rate(0), 100));
+    CHECK(near(p.rate(2), 150));
+    CHECK(near(p.rate(3.5), 187.5));
+    CHECK(p.segment(-1) == 0);
+    CHECK(p.segment(0.5) == 0);
+    CHECK(p.segment(1.5) == 1);
+    CHECK(p.segment(10) == 3);
+
+    LoadProfile q("ramp:100:200:4:2");
+    CHECK(q.segments().size() == 2);
+    CHECK(near(q.segments()[1].start, 2));
+}
+
+static void test_step(void)
+{
+    LoadProfile p("step:100:1,400:2");
+    CHECK(p.segments().size() == 2);
+    CHECK(near(p.duration(), 3));
+    CHECK(near(p.mean_rate(), 300));
+    CHECK(near(p.rate(0.5), 100));
+    CHECK(near(p.rate(2), 400));
+    CHECK(p.segment(0.99) == 0);
+    CHECK(p.segment(1) == 1);
+}
+
+static void test_sine(void)
+{
+    LoadProfile p("sine:100:50:2:4");
+    CHECK(p.segments().size() == 16);
+    CHECK(near(p.duration(), 4));
+    CHECK(near(p.mean_rate(), 100));
+    CHECK(near(p.rate(0.5), 150));
+    CHECK(near(p.rate(1.5), 50));
+}
+
+static void test_file(void)
+{
+    string file = temp_file(".txt");
+    {
+        ofstream f(file);
+        f << "# secs rate\n0 100\n\n2 300 # ramp up\n3 300\n";
+    }
+    LoadProfile p("file:" + file);
+    CHECK(p.segments().size() == 2);
+    CHECK(near(p.duration(), 3));
+    CHECK(near(p.rate(1), 200));
+    CHECK(near(p.rate(2.5), 300));
+
+    {
+        ofstream f(file);
+        f << "1 100\n2 200\n";
+    }
+    CHECK_THROWS(LoadProfile("file:" + file), invalid_argument);
+    {
+        ofstream f(file);
+        f << "0 100\n2\n";
+    }
+    CHECK_THROWS(LoadProfile("file:" + file), invalid_argument);
+    unlink(file.c_str());
+    CHECK_THROWS(LoadProfile("file:" + file), invalid_argument);
+}
+
+static void test_invalid(void)
+{
+    for (const char *spec :
+         {"", "bogus:1:2", "ramp:100:200", "ramp:100:x:4", "ramp:0:100:4",
+          "step:100", "step:100:0", "step:100:1,x", "sine:100:100:2:4",
+          "sine:100:50:2", "file:"}) {
+        CHECK_THROWS(LoadProfile(spec), invalid_argument);
+    }
+}
+
+/* Read a whole trace */
+static vector<uint64_t> read_trace(const string &file)
+{
+    TraceReader r(file);
+    vector<uint64_t> times;
+    uint64_t ns;
+    while (r.next(ns)) {
+        times.push_back(ns);
+    }
+    CHECK(r.eof());
+    return times;
+}
+
+static void test_trace(void)
+{
+    vector<uint64_t> times = {0, 1, 1000, 123456789, UINT64_MAX};
+    for (const char *suffix : {".txt", ".bin"}) {
+        string file = temp_file(suffix);
+        TraceWriter w;
+        w.open(file);
+        for (uint64_t t : times) {
+            w.write(t);
+        }
+        w.close();
+        CHECK(read_trace(file) == times);
+        unlink(file.c_str());
+    }
+
+    // a binary trace ending part way through a time is an error, not its end
+    {
+        string file = temp_file(".bin");
+        TraceWriter w;
+        w.open(file);
+        w.write(10);
+        w.write(300);
+        w.close();
+        CHECK(truncate(file.c_str(), 8 + 1 + 1) == 0);
+        TraceReader r(file);
+        uint64_t ns;
+        CHECK(r.next(ns) and ns == 10);
+        CHECK_THROWS(r.next(ns), runtime_error);
+        unlink(file.c_str());
+    }
+
+    // hand-written text traces: blank lines and DOS line endings
+    string file = temp_file(".txt");
+    {
+        ofstream f(file);
+        f << "10\r\n\r\n20\n\n30";
+    }
+    CHECK(read_trace(file) == vector<uint64_t>({10, 20, 30}));
+
+    {
+        ofstream f(file);
+    }
+    CHECK(read_trace(file).empty());
+
+    {
+        ofstream f(file);
+        f << "10\n2x\n";
+    }
+    TraceReader r(file);
+    uint64_t ns;
+    CHECK(r.next(ns) and ns == 10);
+    CHECK_THROWS(r.next(ns), runtime_error);
+    unlink(file.c_str());
+
+    CHECK_THROWS(TraceReader(file), system_error);
+}
+
+int main(void)
+{
+    test_ramp();
+    test_step();
+    test_sine();
+    test_file();
+    test_invalid();
+    test_trace();
+    return test_status();
+}
@@ -0,0 +1,164 @@
+/**
+ * test_ringbuf.cc - unit tests of the mirrored ring buffer (ringbuf), in
+ * particular of data wrapping around the end of its storage.
+ */
+
+#include <cstring>
+#include <deque>
+#include <random>
+#include <system_error>
+
+#include "buffer.hh"
+#include "pool.hh"
+#include "test.hh"
+
+using namespace std;
+
+using testbuf = ringbuf<1024 * 1024, 4096>;
+
+/* Queue len chars of a running pattern */
+static void queue(testbuf &b, size_t len, unsigned char &next)
+{
+    char *p = b.queue_prep(len);
+    for (size_t i = 0; i < len; i++) {
+        p[i] = next++;
+    }
+    b.queue_commit(len);
+}
+
+/* Do the first len chars queued follow the pattern from first? */
+static bool follows(testbuf &b, size_t len, unsigned char first)
+{
+    const char *p = b.peek(len);
+    for (size_t i = 0; i < len; i++) {
+        if (static_cast<unsigned char>(p[i]) != first++) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Chars queued across the end of the storage read back contiguously */
+static void test_wrap(void)
+{
+    testbuf b;
+    unsigned char in = 0, out = 0;
+    size_t cap = BlockPool::mirrored_size(4096);
+    queue(b, cap - 1000, in);
+    CHECK(b.capacity() == cap);
+
+    // move the head near the end, then queue past it without growing
+    size_t head = cap - 1500;
+    b.drop(head);
+    out += head;
+    queue(b, cap - 1000, in);
+    CHECK(b.capacity() == cap);
+    CHECK(b.items() == cap - 500);
+    CHECK(follows(b, cap - 500, out));
+
+    // the chars past the end are those at the start of the storage
+    const char *base = b.peek(cap - 500) - head;
+    CHECK(memcmp(base + cap, base, cap - 2000) == 0);
+
+    // growing while wrapped keeps the chars in order
+    size_t items = b.items();
+    queue(b, cap, in);
+    CHECK(b.capacity() > cap);
+    CHECK(follows(b, items + cap, out));
+}
+
+/* Random queues and drops match a simple model */
+static void test_model(void)
+{
+    mt19937 rand(1);
+    testbuf b;
+    deque<char> model;
+    unsigned char in = 0;
+    for (unsigned int i = 0; i < 20000; i++) {
+        size_t n = rand() % 6000 + 1;
+        if (rand() % 2 and n <= b.space()) {
+            char *p = b.queue_prep(n);
+            for (size_t j = 0; j < n; j++) {
+                p[j] = in;
+                model.push_back(in++);
+            }
+            b.queue_commit(n);
+        } else {
+            n = min(n, b.items());
+            b.drop(n);
+            model.erase(model.begin(), model.begin() + n);
+        }
+
+        CHECK(b.items() == model.size());
+        if (b.items() > 0) {
+            const char *p = b.peek(b.items());
+            CHECK(equal(model.begin(), model.end(), p));
+        }
+    }
+}
+
+/* Pinned chars stay put when the buffer grows, until unpinned */
+static void test_pin(void)
+{
+    testbuf b;
+    unsigned char in = 0;
+    queue(b, 4000, in);
+    const char *pinned = b.peek(4000);
+    b.pin();
+    queue(b, 20000, in);
+    CHECK(b.capacity() > 4096);
+    CHECK(b.peek(1) != pinned);
+    CHECK(follows(b, 24000, 0));
+
+    // still readable where they were
+    bool same = true;
+    for (size_t i = 0; i < 4000; i++) {
+        same = same and static_cast<unsigned char>(pinned[i]) == (i & 0xff);
+    }
+    CHECK(same);
+    b.unpin();
+
+    // disowning the current storage while pinned hands it over
+    testbuf c;
+    queue(c, 100, in);
+    const char *p = c.peek(100);
+    c.pin();
+    size_t cap;
+    char *block = c.disown(cap);
+    CHECK(block == p);
+    CHECK(cap == BlockPool::mirrored_size(4096));
+    CHECK(c.items() == 0 and c.capacity() == 0);
+    BlockPool::local().free_mirrored(block, cap);
+
+    testbuf d;
+    CHECK(d.disown(cap) == nullptr and cap == 0);
+}
+
+/* A large buffer shrinks back once drained, and never beyond its limit */
+static void test_shrink(void)
+{
+    testbuf b;
+    unsigned char in = 0;
+    queue(b, 100000, in);
+    CHECK(b.capacity() >= 100000);
+    b.shrink();
+    CHECK(b.capacity() >= 100000);
+    b.clear();
+    b.shrink();
+    CHECK(b.capacity() == 0);
+    queue(b, 10, in);
+    CHECK(b.capacity() == BlockPool::mirrored_size(4096));
+
+    CHECK_THROWS(b.reserve(b.size()), system_error);
+    CHECK_THROWS(b.drop(11), system_error);
+    CHECK_THROWS(b.peek(11), system_error);
+}
+
+int main(void)
+{
+    test_wrap();
+    test_model();
+    test_pin();
+    test_shrink();
+    return test_status();
+}
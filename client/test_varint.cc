@@ -0,0 +1,118 @@
+/**
+ * test_varint.cc - unit tests of varint encoding, and of sample dumps
+ * (SampleWriter / SampleReader, as decoded by mutated_samples) built on it.
+ */
+
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+#include "samples.hh"
+#include "test.hh"
+#include "varint.hh"
+
+using namespace std;
+
+/* Values round trip through a buffer and a stream, in as few bytes as they
+ * need */
+static void test_roundtrip(void)
+{
+    vector<pair<uint64_t, size_t>> cases = {
+      {0, 1},
+      {1, 1},
+      {127, 1},
+      {128, 2},
+      {16383, 2},
+      {16384, 3},
+      {uint64_t(1) << 32, 5},
+      {(uint64_t(1) << 63) - 1, 9},
+      {uint64_t(1) << 63, 10},
+      {UINT64_MAX, 10},
+    };
+
+    stringstream ss;
+    for (auto &c : cases) {
+        char buf[10];
+        CHECK(encode_varint(c.first, buf) == c.second);
+        write_varint(ss, c.first);
+    }
+    for (auto &c : cases) {
+        uint64_t v;
+        CHECK(read_varint(ss, v));
+        CHECK(v == c.first);
+    }
+
+    uint64_t v;
+    CHECK(not read_varint(ss, v));
+}
+
+/* Truncated and overlong varints are errors */
+static void test_corrupt(void)
+{
+    uint64_t v;
+    stringstream truncated(string("\x80\x80", 2));
+    CHECK_THROWS(read_varint(truncated, v), runtime_error);
+
+    stringstream overlong(string(10, '\xff') + '\x01');
+    CHECK_THROWS(read_varint(overlong, v), runtime_error);
+}
+
+/* Sample dumps read back the same, including times that go backwards and
+ * more samples than are buffered at once */
+static void test_samples(void)
+{
+    string file = temp_file(".smp");
+    mt19937_64 rand(1);
+    vector<Sample> samples;
+    uint64_t t = 1000000000;
+    for (unsigned int i = 0; i < 100000; i++) {
+        Sample s;
+        s.deadline = t + rand() % 100000 - 50000;
+        s.start = s.deadline + rand() % 1000;
+        s.sent = s.start + rand() % 1000;
+        s.recv = s.sent + rand() % 1000000;
+        s.conn = rand() % 1000;
+        s.op = rand() % 4;
+        s.measure = rand() % 2;
+        samples.push_back(s);
+        t += 10000;
+    }
+    // extremes: the start of the experiment, and far from it
+    samples.push_back({0, 0, 0, 0, 0, 0, false});
+    samples.push_back({UINT64_MAX / 2, UINT64_MAX / 2, UINT64_MAX / 2,
+                       UINT64_MAX, UINT64_MAX, 255, true});
+
+    {
+        SampleWriter w;
+        w.open(file);
+        for (auto &s : samples) {
+            w.write(s);
+        }
+    }
+
+    SampleReader r(file);
+    Sample s;
+    size_t n = 0;
+    for (; n < samples.size() and r.next(s); n++) {
+        const Sample &e = samples[n];
+        CHECK(s.deadline == e.deadline and s.start == e.start and
+              s.sent == e.sent and s.recv == e.recv and s.conn == e.conn and
+              s.op == e.op and s.measure == e.measure);
+    }
+    CHECK(n == samples.size());
+    CHECK(not r.next(s));
+    unlink(file.c_str());
+
+    CHECK_THROWS(SampleReader(file), runtime_error);
+}
+
+int main(void)
+{
+    test_roundtrip();
+    test_corrupt();
+    test_samples();
+    return test_status();
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+
+#include "timeseries.hh"
+
+using namespace std;
+
+TimeSeries::~TimeSeries(void) noexcept
+{
+    if (close_) {
+        fclose(out_);
+    }
+}
+
+/**
+ * Open the time series for output.
+ * @file: the file to write to, or stdout if empty.
+ * @window: the length of each window.
+ * @shard: the event loop the samples come from, reported with each window.
+ */
+void TimeSeries::open(const string &file, duration window,
+                      unsigned int shard)
+{
+    if (window <= duration(0)) {
+        throw invalid_argument("TimeSeries::open: empty window");
+    }
+
+    if (file.empty()) {
+        out_ = stdout;
+    } else {
+        out_ = fopen(file.c_str(), "w");
+        if (out_ == nullptr) {
+            throw system_error(errno, system_category(),
+                               "TimeSeries::open: can't open " + file);
+        }
+        close_ = true;
+    }
+    shard_ = shard;
+    window_ = window;
+
+    // stdout is shared by all shards
+    if (close_ or shard == 0) {
+        fprintf(out_, "#window: shard\tstart\treqs/s\t\tavg\t\t50th\t99th"
+                      "\t99.9th\tmax\tbuffer99\twait99\n");
+        fflush(out_);
+    }
+}
+
+void TimeSeries::start(time_point now)
+{
+    if (end_ != time_point{}) {
+        flush(end_);
+    }
+    start_ = now;
+    end_ = now + window_;
+}
+
+void TimeSeries::finish(time_point now)
+{
+    if (now >= end_) {
+        rotate(now);
+    }
+    flush(now);
+    end_ = time_point{};
+}
+
+/**
+ * Close windows until the one `now` falls in.
+ */
+void TimeSeries::rotate(time_point now)
+{
+    if (end_ == time_point{}) {
+        return; // not started
+    }
+    while (now >= end_) {
+        flush(end_);
+        end_ += window_;
+    }
+}
+
+/**
+ * Write out the current window and start the next.
+ * @until: when the window closed (earlier than end_ for the last window).
+ */
+void TimeSeries::flush(time_point until)
+{
+    time_point from = end_ - window_;
+    double start_s = chrono::duration<double>(from - start_).count();
+    double secs = chrono::duration<double>(until - from).count();
+    if (secs <= 0) {
+        secs = chrono::duration<double>(window_).count();
+    }
+
+    // format the whole line first, and write it at once, so that lines of
+    // shards sharing stdout don't interleave
+    char line[256];
+    int n = snprintf(line, sizeof(line), "         %u\t%.3f\t%f\t", shard_,
+                     start_s, service_.size() / secs);
+    if (service_.size() == 0) {
+        n += snprintf(line + n, sizeof(line) - n, "-\t\t-\t-\t-\t-\t-\t-\n");
+    } else {
+        n += snprintf(line + n, sizeof(line) - n,
+                      "%f\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+                      "\t%" PRIu64 "\t%" PRIu64 "\n",
+                      service_.mean(), service_.percentile(0.5),
+                      service_.percentile(0.99), service_.percentile(0.999),
+                      service_.max(), queue_.percentile(0.99),
+                      wait_.percentile(0.99));
+    }
+    fwrite(line, 1, min(size_t(n), sizeof(line) - 1), out_);
+    fflush(out_);
+
+    if (keep_) {
+        uint64_t start_ms = chrono::duration_cast<chrono::milliseconds>(
+                              from - start_).count();
+        uint64_t length_ms =
+          chrono::duration_cast<chrono::milliseconds>(window_).count();
+        history_.push_back({"service", start_ms, length_ms, service_});
+        history_.push_back({"buffer", start_ms, length_ms, queue_});
+        history_.push_back({"wait", start_ms, length_ms, wait_});
+    }
+
+    service_.clear();
+    queue_.clear();
+    wait_.clear();
+}
@@ -0,0 +1,119 @@
+#ifndef MUTATED_TIMESERIES_HH
+#define MUTATED_TIMESERIES_HH
+
+/**
+ * timeseries.hh - latency and throughput reported per fixed-length window of
+ * the run, streamed out as each window closes.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "clock.hh"
+#include "histfile.hh"
+#include "histogram.hh"
+
+/**
+ * Accumulates samples into a histogram per window, writing out a line of
+ * statistics for each window once it closes. Windows cover the whole run
+ * (warm-up and cool-down included) and are timed from the start of the
+ * experiment; a sample is counted in the window its response arrived in.
+ * Windows close as samples arrive, and on `tick` from the event loop, so that
+ * a window without responses (a stalled server) is still reported on time.
+ */
+class TimeSeries
+{
+  public:
+    using clock = Clock;
+    using time_point = clock::time_point;
+    using duration = std::chrono::nanoseconds;
+
+  private:
+    FILE *out_;
+    bool close_; /* did we open out_? */
+    unsigned int shard_;
+    duration window_;
+    time_point start_; /* start of the experiment */
+    time_point end_;   /* end of the current window */
+    Histogram service_;
+    Histogram queue_;
+    Histogram wait_;
+    bool keep_;                      /* keep each window's histograms? */
+    std::vector<HistEntry> history_; /* histograms of each window so far */
+
+    void rotate(time_point now);
+    void flush(time_point until);
+
+  public:
+    TimeSeries(void) noexcept : out_{nullptr},
+                                close_{false},
+                                shard_{0},
+                                window_{0},
+                                start_{},
+                                end_{},
+                                service_{},
+                                queue_{},
+                                wait_{},
+                                keep_{false},
+                                history_{}
+    {
+    }
+    ~TimeSeries(void) noexcept;
+
+    /* No copy or move */
+    TimeSeries(const TimeSeries &) = delete;
+    TimeSeries(TimeSeries &&) = delete;
+    TimeSeries &operator=(const TimeSeries &) = delete;
+    TimeSeries &operator=(TimeSeries &&) = delete;
+
+    /* Report windows of the given length to a file (stdout if empty) */
+    void open(const std::string &file, duration window, unsigned int shard);
+
+    bool is_open(void) const noexcept { return out_ != nullptr; }
+
+    /* Start timing windows, closing any left open by a previous run */
+    void start(time_point now);
+
+    /* Close the last (partial) window */
+    void finish(time_point now);
+
+    /* Keep the histograms of each window, e.g., to save them */
+    void keep_history(void) noexcept { keep_ = true; }
+    void clear_history(void) noexcept { history_.clear(); }
+    const std::vector<HistEntry> &history(void) const noexcept
+    {
+        return history_;
+    }
+
+    /* Merge the windows of another (concurrent) time series into ours */
+    void merge_history(const TimeSeries &other)
+    {
+        merge_histograms(history_, other.history_);
+    }
+
+    /* When the current window closes (or the epoch if not started) */
+    time_point window_end(void) const noexcept { return end_; }
+
+    /* Close the windows that have ended by now */
+    void tick(time_point now)
+    {
+        if (now >= end_) {
+            rotate(now);
+        }
+    }
+
+    void add_sample(time_point now, uint64_t queue, uint64_t service,
+                    uint64_t wait)
+    {
+        if (now >= end_) {
+            rotate(now);
+        }
+        queue_.add_sample(queue);
+        service_.add_sample(service);
+        wait_.add_sample(wait);
+    }
+};
+
+#endif /* MUTATED_TIMESERIES_HH */
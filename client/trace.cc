@@ -0,0 +1,152 @@
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.hh"
+#include "util.hh"
+#include "varint.hh"
+
+using namespace std;
+
+/* Header identifying a binary trace */
+static constexpr char TRACE_MAGIC[] = "MUTIAT01";
+static constexpr size_t TRACE_MAGIC_SIZE = sizeof(TRACE_MAGIC) - 1;
+
+/**
+ * Map a trace for reading.
+ * @file: the trace file.
+ */
+TraceReader::TraceReader(const string &file)
+  : fd_{-1}
+  , base_{nullptr}
+  , end_{nullptr}
+  , pos_{nullptr}
+  , binary_{false}
+{
+    struct stat st;
+
+    fd_ = system_call(open(file.c_str(), O_RDONLY),
+                      "TraceReader: open(" + file + ")");
+    system_call(fstat(fd_, &st), "TraceReader: fstat()");
+    if (st.st_size == 0) {
+        return;
+    }
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (p == MAP_FAILED) {
+        throw system_error(errno, system_category(), "TraceReader: mmap()");
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    base_ = pos_ = reinterpret_cast<const char *>(p);
+    end_ = base_ + st.st_size;
+
+    if (size_t(end_ - pos_) >= TRACE_MAGIC_SIZE and
+        memcmp(pos_, TRACE_MAGIC, TRACE_MAGIC_SIZE) == 0) {
+        binary_ = true;
+        pos_ += TRACE_MAGIC_SIZE;
+    }
+}
+
+/**
+ * Unmap the trace.
+ */
+TraceReader::~TraceReader(void) noexcept
+{
+    if (base_ != nullptr) {
+        munmap(const_cast<char *>(base_), end_ - base_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+/**
+ * Read the next inter-arrival time from the trace.
+ * @ns: the inter-arrival time read (nanoseconds).
+ * @return: false if the end of the trace was reached.
+ */
+bool TraceReader::next(uint64_t &ns)
+{
+    ns = 0;
+
+    if (binary_) {
+        if (pos_ == end_) {
+            return false;
+        }
+        for (unsigned int shift = 0; pos_ < end_; shift += 7) {
+            uint8_t b = *pos_++;
+            ns |= uint64_t(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return true;
+            } else if (shift > 56) {
+                throw runtime_error("TraceReader::next: corrupt varint");
+            }
+        }
+        throw runtime_error("TraceReader::next: truncated varint");
+    }
+
+    if (eof()) {
+        return false;
+    }
+
+    for (; pos_ < end_ and *pos_ != '\n' and *pos_ != '\r'; pos_++) {
+        if (*pos_ < '0' or *pos_ > '9') {
+            throw runtime_error("TraceReader::next: invalid trace entry");
+        }
+        ns = ns * 10 + (*pos_ - '0');
+    }
+    return true;
+}
+
+/**
+ * Check if the end of the trace has been reached.
+ */
+bool TraceReader::eof(void)
+{
+    if (not binary_) {
+        // skip blank lines
+        while (pos_ < end_ and (*pos_ == '\n' or *pos_ == '\r')) {
+            pos_++;
+        }
+    }
+    return pos_ == end_;
+}
+
+/**
+ * Open a trace for writing.
+ * @file: the trace file, written in binary if it ends in '.bin'.
+ */
+void TraceWriter::open(const string &file)
+{
+    const string ext = ".bin";
+    binary_ = file.size() >= ext.size() and
+              file.compare(file.size() - ext.size(), ext.size(), ext) == 0;
+
+    f_.open(file, ios::out | ios::trunc | ios::binary);
+    if (not f_) {
+        throw runtime_error("TraceWriter::open: can't open " + file);
+    }
+    if (binary_) {
+        f_.write(TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    }
+}
+
+/**
+ * Append an inter-arrival time to the trace.
+ * @ns: the inter-arrival time (nanoseconds).
+ */
+void TraceWriter::write(uint64_t ns)
+{
+    if (not binary_) {
+        f_ << ns << "\n";
+        return;
+    }
+
+    write_varint(f_, ns);
+}
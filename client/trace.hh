@@ -0,0 +1,65 @@
+#ifndef MUTATED_TRACE_HH
+#define MUTATED_TRACE_HH
+
+/**
+ * trace.hh - reading and writing inter-arrival time traces.
+ *
+ * A trace is a sequence of inter-arrival times in nanoseconds, stored either
+ * as text (one per line) or in a compact binary format: an 8-byte magic header
+ * followed by each time as an unsigned LEB128 varint.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/**
+ * Reads a trace through a memory mapping of the file, decoding one entry at a
+ * time, so replay memory use is flat however long the trace is.
+ */
+class TraceReader
+{
+  private:
+    int fd_;
+    const char *base_; /* start of mapping */
+    const char *end_;  /* one-past end of mapping */
+    const char *pos_;  /* next entry */
+    bool binary_;
+
+  public:
+    explicit TraceReader(const std::string &file);
+    ~TraceReader(void) noexcept;
+
+    /* No copy or move */
+    TraceReader(const TraceReader &) = delete;
+    TraceReader(TraceReader &&) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+    TraceReader &operator=(TraceReader &&) = delete;
+
+    /* Read the next inter-arrival time, false at end of trace */
+    bool next(uint64_t &ns);
+
+    /* Is the end of the trace reached? */
+    bool eof(void);
+};
+
+/**
+ * Writes a trace, in binary if the file name ends in '.bin', else as text.
+ */
+class TraceWriter
+{
+  private:
+    std::ofstream f_;
+    bool binary_;
+
+  public:
+    TraceWriter(void) noexcept : f_{}, binary_{false} {}
+    ~TraceWriter(void) noexcept {}
+
+    void open(const std::string &file);
+    bool is_open(void) const { return f_.is_open(); }
+    void write(uint64_t ns);
+    void close(void) { f_.close(); }
+};
+
+#endif /* MUTATED_TRACE_HH */
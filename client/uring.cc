@@ -0,0 +1,503 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include "limits.hh"
+#include "pool.hh"
+#include "uring.hh"
+#include "util.hh"
+
+using namespace std;
+
+uint64_t Uring::attach(void *owner)
+{
+    uint64_t id = next_id_++;
+    owners_[id] = owner;
+    return id;
+}
+
+/**
+ * Free the block parked for an operation, if any.
+ * @cookie: the cookie of the operation.
+ * @return: was a block parked for it?
+ */
+bool Uring::unpark(uint64_t cookie)
+{
+    auto it = parked_.find(cookie);
+    if (it == parked_.end()) {
+        return false;
+    }
+    BlockPool::local().free_mirrored(it->second.first, it->second.second);
+    parked_.erase(it);
+    return true;
+}
+
+#ifdef MUTATED_NO_URING
+
+/* Without io_uring, construction fails, so nothing else is ever reached */
+Uring::Uring(unsigned int, bool)
+  : fd_{-1}
+  , sqpoll_{false}
+  , sq_ring_{nullptr}
+  , sq_ring_sz_{0}
+  , sq_head_{nullptr}
+  , sq_tail_{nullptr}
+  , sq_flags_{nullptr}
+  , sq_array_{nullptr}
+  , sq_mask_{0}
+  , sq_entries_{0}
+  , sqes_{nullptr}
+  , sqes_sz_{0}
+  , sqe_tail_{0}
+  , cq_ring_{nullptr}
+  , cq_ring_sz_{0}
+  , cq_head_{nullptr}
+  , cq_tail_{nullptr}
+  , cq_mask_{0}
+  , cqes_{nullptr}
+  , timespecs_{}
+  , buf_ring_{nullptr}
+  , buf_ring_sz_{0}
+  , bufs_{nullptr}
+  , buf_tail_{0}
+  , bufs_used_{}
+  , owners_{}
+  , next_id_{1}
+  , parked_{}
+{
+    throw runtime_error("Uring: built without io_uring support");
+}
+
+Uring::~Uring(void) noexcept {}
+void Uring::recv(int, uint64_t) {}
+void Uring::send(int, const char *, size_t, uint64_t, int) {}
+void Uring::send_zc(int, const char *, size_t, uint64_t) {}
+void Uring::timeout(chrono::nanoseconds, uint64_t) {}
+void Uring::cancel_timeout(uint64_t) {}
+void Uring::cancel(uint64_t) {}
+void Uring::submit(void) {}
+unsigned int Uring::wait(Event *, unsigned int, bool) { return 0; }
+
+#else /* !MUTATED_NO_URING */
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int io_uring_setup(unsigned int entries, io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+                          unsigned int min_complete, unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned int op, void *arg,
+                             unsigned int nr)
+{
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+/* Ring indexes are shared with the kernel */
+static unsigned int load_acquire(const unsigned int *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(unsigned int *p, unsigned int v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void *map_ring(int fd, size_t size, off_t offset)
+{
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (p == MAP_FAILED) {
+        throw system_error(errno, system_category(), "Uring::Uring: mmap()");
+    }
+    return p;
+}
+
+/**
+ * Set up an io_uring and register its receive buffers.
+ * @entries: the size of the submission queue.
+ * @sqpoll: submit with a kernel thread polling the submission queue, rather
+ * than with a syscall.
+ */
+Uring::Uring(unsigned int entries, bool sqpoll)
+  : fd_{-1}
+  , sqpoll_{sqpoll}
+  , sq_ring_{nullptr}
+  , sq_ring_sz_{0}
+  , sq_head_{nullptr}
+  , sq_tail_{nullptr}
+  , sq_flags_{nullptr}
+  , sq_array_{nullptr}
+  , sq_mask_{0}
+  , sq_entries_{0}
+  , sqes_{nullptr}
+  , sqes_sz_{0}
+  , sqe_tail_{0}
+  , cq_ring_{nullptr}
+  , cq_ring_sz_{0}
+  , cq_head_{nullptr}
+  , cq_tail_{nullptr}
+  , cq_mask_{0}
+  , cqes_{nullptr}
+  , timespecs_{}
+  , buf_ring_{nullptr}
+  , buf_ring_sz_{0}
+  , bufs_{nullptr}
+  , buf_tail_{0}
+  , bufs_used_{}
+  , owners_{}
+  , next_id_{1}
+  , parked_{}
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * URING_CQ_FACTOR;
+    if (sqpoll) {
+        p.flags |= IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = URING_SQPOLL_IDLE_MS;
+    }
+    fd_ = system_call(io_uring_setup(entries, &p),
+                      "Uring::Uring: io_uring_setup()");
+    if (not(p.features & IORING_FEAT_SINGLE_MMAP) or
+        not(p.features & IORING_FEAT_NODROP)) {
+        close(fd_);
+        throw runtime_error("Uring::Uring: kernel io_uring too old");
+    }
+
+    // the submission and completion queues share one mapping
+    sq_ring_sz_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_ring_sz_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    sq_ring_sz_ = max(sq_ring_sz_, cq_ring_sz_);
+    sq_ring_ = map_ring(fd_, sq_ring_sz_, IORING_OFF_SQ_RING);
+    cq_ring_ = sq_ring_;
+    sqes_sz_ = p.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = map_ring(fd_, sqes_sz_, IORING_OFF_SQES);
+
+    char *sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+    sq_flags_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.flags);
+    sq_array_ = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+    sqe_tail_ = *sq_tail_;
+    timespecs_.resize(2 * sq_entries_);
+
+    char *cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+    cqes_ = cq + p.cq_off.cqes;
+
+    // receive buffers: a ring of their descriptors shared with the kernel,
+    // which picks one for each multishot receive completion
+    buf_ring_sz_ = URING_BUFS * sizeof(io_uring_buf);
+    buf_ring_ = mmap(nullptr, buf_ring_sz_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufs_ = static_cast<char *>(mmap(nullptr, URING_BUFS * URING_BUF_SIZE,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (buf_ring_ == MAP_FAILED or bufs_ == MAP_FAILED) {
+        throw system_error(errno, system_category(),
+                           "Uring::Uring: mmap(buffers)");
+    }
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = 0;
+    system_call(io_uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1),
+                "Uring::Uring: io_uring_register(PBUF_RING)");
+    for (uint16_t i = 0; i < URING_BUFS; i++) {
+        bufs_used_.push_back(i);
+    }
+    recycle_buffers();
+}
+
+Uring::~Uring(void) noexcept
+{
+    // the kernel may read parked blocks until their operations complete,
+    // which they soon do, having been cancelled
+    store_release(sq_tail_, sqe_tail_);
+    while (not parked_.empty()) {
+        unsigned int to_submit =
+          sqpoll_ ? 0 : sqe_tail_ - load_acquire(sq_head_);
+        unsigned int flags = IORING_ENTER_GETEVENTS;
+        if (sqpoll_) {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+        if (io_uring_enter(fd_, to_submit, 1, flags) < 0 and errno != EINTR) {
+            break; // leak them rather than risk their reuse
+        }
+
+        unsigned int head = *cq_head_, tail = load_acquire(cq_tail_);
+        io_uring_cqe *cqes = static_cast<io_uring_cqe *>(cqes_);
+        for (; head != tail; head++) {
+            io_uring_cqe &cqe = cqes[head & cq_mask_];
+            if (not(cqe.flags & IORING_CQE_F_MORE)) {
+                unpark(cqe.user_data);
+            }
+        }
+        store_release(cq_head_, head);
+    }
+
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_sz_);
+    }
+    if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_sz_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+    if (buf_ring_ != nullptr and buf_ring_ != MAP_FAILED) {
+        munmap(buf_ring_, buf_ring_sz_);
+    }
+    if (bufs_ != nullptr and bufs_ != MAP_FAILED) {
+        munmap(bufs_, URING_BUFS * URING_BUF_SIZE);
+    }
+}
+
+/**
+ * Give the receive buffers handed out by the last `wait` back to the kernel.
+ */
+void Uring::recycle_buffers(void)
+{
+    if (bufs_used_.empty()) {
+        return;
+    }
+
+    // the ring is an array of descriptors, with its tail overlaid on the
+    // first's reserved field (as io_uring_buf_ring has it, whose flexible
+    // array is misplaced when compiled as C++)
+    io_uring_buf *ring = static_cast<io_uring_buf *>(buf_ring_);
+    for (uint16_t bid : bufs_used_) {
+        io_uring_buf &b = ring[buf_tail_++ & (URING_BUFS - 1)];
+        b.addr = reinterpret_cast<uint64_t>(bufs_ + bid * URING_BUF_SIZE);
+        b.len = URING_BUF_SIZE;
+        b.bid = bid;
+    }
+    __atomic_store_n(&ring[0].resv, buf_tail_, __ATOMIC_RELEASE);
+    bufs_used_.clear();
+}
+
+/**
+ * The next free submission queue entry, zeroed, submitting if we're full.
+ */
+void *Uring::next_sqe(void)
+{
+    while (sqe_tail_ - load_acquire(sq_head_) >= sq_entries_) {
+        submit();
+        if (sqpoll_) {
+            system_call(io_uring_enter(fd_, 0, 0, IORING_ENTER_SQ_WAIT),
+                        "Uring::next_sqe: io_uring_enter()");
+        }
+    }
+
+    unsigned int slot = sqe_tail_ & sq_mask_;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[slot] = slot;
+    sqe_tail_++;
+    return sqe;
+}
+
+/**
+ * Queue a multishot receive, completing with each segment of data received
+ * in one of our buffers, until it fails or runs out of buffers.
+ * @fd: the socket.
+ * @cookie: the operation's cookie.
+ */
+void Uring::recv(int fd, uint64_t cookie)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = cookie;
+}
+
+/**
+ * Queue a send.
+ * @fd: the socket.
+ * @buf: the data, which must stay valid until the send completes.
+ * @len: the length of the data.
+ * @cookie: the operation's cookie.
+ * @flags: send(2) flags (e.g., MSG_MORE).
+ */
+void Uring::send(int fd, const char *buf, size_t len, uint64_t cookie,
+                 int flags)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->msg_flags = flags;
+    sqe->user_data = cookie;
+}
+
+/**
+ * Queue a zero-copy send, where the kernel transmits from the data's pages
+ * rather than a copy, so the data must not change until the kernel is done
+ * with them (which we don't report, so use immutable data).
+ * @fd: the socket.
+ * @buf: the data.
+ * @len: the length of the data.
+ * @cookie: the operation's cookie.
+ */
+void Uring::send_zc(int fd, const char *buf, size_t len, uint64_t cookie)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_SEND_ZC;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->user_data = cookie;
+}
+
+/**
+ * Queue a timeout, completing with -ETIME once it expires.
+ * @after: how long from submission it expires.
+ * @cookie: the operation's cookie.
+ */
+void Uring::timeout(chrono::nanoseconds after, uint64_t cookie)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    int64_t *ts = &timespecs_[2 * ((sqe_tail_ - 1) & sq_mask_)];
+    ts[0] = after.count() / 1000000000;
+    ts[1] = after.count() % 1000000000;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(ts);
+    sqe->len = 1;
+    sqe->user_data = cookie;
+}
+
+/**
+ * Queue the removal of a pending timeout, which then completes with
+ * -ECANCELED (unless it has already expired).
+ * @cookie: the cookie of the timeout.
+ */
+void Uring::cancel_timeout(uint64_t cookie)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = cookie;
+    sqe->user_data = 0;
+}
+
+/**
+ * Queue the cancellation of a pending operation, which then completes with
+ * -ECANCELED (unless it has already completed).
+ * @cookie: the cookie of the operation.
+ */
+void Uring::cancel(uint64_t cookie)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(next_sqe());
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = cookie;
+    sqe->user_data = 0;
+}
+
+/**
+ * Submit the queued operations: with a syscall, or by waking the kernel's
+ * polling thread if it has gone idle.
+ */
+void Uring::submit(void)
+{
+    store_release(sq_tail_, sqe_tail_);
+    if (sqpoll_) {
+        if (load_acquire(sq_flags_) & IORING_SQ_NEED_WAKEUP) {
+            system_call(io_uring_enter(fd_, 0, 0, IORING_ENTER_SQ_WAKEUP),
+                        "Uring::submit: io_uring_enter()");
+        }
+        return;
+    }
+
+    unsigned int n = sqe_tail_ - load_acquire(sq_head_);
+    if (n > 0 and io_uring_enter(fd_, n, 0, 0) < 0 and errno != EBUSY and
+        errno != EAGAIN and errno != EINTR) {
+        throw system_error(errno, system_category(),
+                           "Uring::submit: io_uring_enter()");
+    }
+}
+
+/**
+ * Submit queued operations and reap their completions.
+ * @events: where to return completions.
+ * @max: the most completions to return.
+ * @block: wait for at least one completion?
+ * @return: the number of completions returned.
+ */
+unsigned int Uring::wait(Event *events, unsigned int max, bool block)
+{
+    recycle_buffers();
+    store_release(sq_tail_, sqe_tail_);
+
+    unsigned int to_submit = sqpoll_ ? 0 : sqe_tail_ - load_acquire(sq_head_);
+    unsigned int flags = 0, min_complete = 0;
+    unsigned int sq_flags = load_acquire(sq_flags_);
+    if (sqpoll_ and (sq_flags & IORING_SQ_NEED_WAKEUP)) {
+        flags |= IORING_ENTER_SQ_WAKEUP;
+    }
+    if (sq_flags & IORING_SQ_CQ_OVERFLOW) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (block and load_acquire(cq_tail_) == *cq_head_) {
+        flags |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+    }
+    if ((to_submit > 0 or flags != 0) and
+        io_uring_enter(fd_, to_submit, min_complete, flags) < 0 and
+        errno != EBUSY and errno != EAGAIN and errno != EINTR) {
+        throw system_error(errno, system_category(),
+                           "Uring::wait: io_uring_enter()");
+    }
+
+    unsigned int n = 0;
+    unsigned int head = *cq_head_, tail = load_acquire(cq_tail_);
+    io_uring_cqe *cqes = static_cast<io_uring_cqe *>(cqes_);
+    for (; head != tail and n < max; head++) {
+        io_uring_cqe &cqe = cqes[head & cq_mask_];
+        if (not(cqe.flags & IORING_CQE_F_MORE) and not parked_.empty() and
+            unpark(cqe.user_data)) {
+            continue; // last completion of an operation whose owner's gone
+        } else if (cqe.user_data == 0 or (cqe.flags & IORING_CQE_F_NOTIF)) {
+            continue; // cancellations, and kernel done with zero-copy data
+        }
+
+        Event &ev = events[n++];
+        ev.cookie = cqe.user_data;
+        ev.res = cqe.res;
+        ev.more = cqe.flags & IORING_CQE_F_MORE;
+        ev.buf = nullptr;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            ev.buf = bufs_ + bid * URING_BUF_SIZE;
+            bufs_used_.push_back(bid);
+        }
+    }
+    store_release(cq_head_, head);
+    return n;
+}
+
+#endif /* !MUTATED_NO_URING */
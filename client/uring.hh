@@ -0,0 +1,140 @@
+#ifndef MUTATED_URING_HH
+#define MUTATED_URING_HH
+
+/**
+ * uring.hh - a minimal io_uring backend for an event loop: socket sends, a
+ * multishot receive per socket into a ring of provided buffers, and timeouts.
+ * Talks to the kernel directly, without liburing. Building with
+ * MUTATED_NO_URING (configure --disable-uring) leaves it out.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * An io_uring instance, not thread-safe, used by one event loop. Operations
+ * carry a 64-bit cookie, made with `cookie` from an id and the kind of
+ * operation, that's returned with their completions. Operations are queued
+ * and only submitted to the kernel on `submit` or `wait` (or continuously by
+ * a kernel thread with SQPOLL).
+ */
+class Uring
+{
+  public:
+    /* Kinds of operation, in the low bits of a cookie */
+    enum Kind : uint64_t {
+        TIMER = 1,
+        RECV = 2,
+        SEND = 3,
+    };
+
+    /* A completed operation */
+    struct Event {
+        uint64_t cookie; /* the cookie of the operation */
+        int32_t res;     /* its result (bytes, or negative errno) */
+        bool more;       /* a multishot operation will complete again */
+        char *buf;       /* received data, valid until the next `wait` */
+    };
+
+    static uint64_t cookie(uint64_t id, Kind kind) noexcept
+    {
+        return id << 2 | kind;
+    }
+    static uint64_t cookie_id(uint64_t cookie) noexcept { return cookie >> 2; }
+    static Kind cookie_kind(uint64_t cookie) noexcept
+    {
+        return static_cast<Kind>(cookie & 3);
+    }
+
+  private:
+    int fd_;
+    bool sqpoll_;
+
+    /* Submission queue, and where we'll place the next entry */
+    void *sq_ring_;
+    std::size_t sq_ring_sz_;
+    unsigned int *sq_head_, *sq_tail_, *sq_flags_, *sq_array_;
+    unsigned int sq_mask_, sq_entries_;
+    void *sqes_;
+    std::size_t sqes_sz_;
+    unsigned int sqe_tail_;
+
+    /* Completion queue (may share the submission queue's mapping) */
+    void *cq_ring_;
+    std::size_t cq_ring_sz_;
+    unsigned int *cq_head_, *cq_tail_;
+    unsigned int cq_mask_;
+    void *cqes_;
+
+    /* Timeouts (seconds, nanoseconds) of queued entries, by entry slot, as
+     * the kernel only reads them once they're submitted */
+    std::vector<int64_t> timespecs_;
+
+    /* Provided receive buffers, and those handed out by the last `wait` */
+    void *buf_ring_;
+    std::size_t buf_ring_sz_;
+    char *bufs_;
+    uint16_t buf_tail_;
+    std::vector<uint16_t> bufs_used_;
+
+    /* Owners of operations (e.g., sockets), by id */
+    std::unordered_map<uint64_t, void *> owners_;
+    uint64_t next_id_;
+
+    /* Mirrored blocks (and their sizes) kept for operations, by cookie */
+    std::unordered_map<uint64_t, std::pair<void *, std::size_t>> parked_;
+
+    void *next_sqe(void);
+    void recycle_buffers(void);
+    bool unpark(uint64_t cookie);
+
+  public:
+    Uring(unsigned int entries, bool sqpoll);
+    ~Uring(void) noexcept;
+
+    /* No copy or move */
+    Uring(const Uring &) = delete;
+    Uring(Uring &&) = delete;
+    Uring &operator=(const Uring &) = delete;
+    Uring &operator=(Uring &&) = delete;
+
+    /* Register an owner of operations, returning its id (never 0) */
+    uint64_t attach(void *owner);
+    void detach(uint64_t id) { owners_.erase(id); }
+
+    /* The owner of an id, or null if it has since been detached */
+    void *owner(uint64_t id) const
+    {
+        auto it = owners_.find(id);
+        return it == owners_.end() ? nullptr : it->second;
+    }
+
+    /* Keep a mirrored block of the thread's BlockPool that an operation uses
+     * (e.g., the data of a send whose owner is gone) until the operation has
+     * completed for good, then free it */
+    void park(uint64_t cookie, void *block, std::size_t bytes)
+    {
+        parked_[cookie] = std::make_pair(block, bytes);
+    }
+
+    /* Queue operations */
+    void recv(int fd, uint64_t cookie);
+    void send(int fd, const char *buf, std::size_t len, uint64_t cookie,
+              int flags = 0);
+    void send_zc(int fd, const char *buf, std::size_t len, uint64_t cookie);
+    void timeout(std::chrono::nanoseconds after, uint64_t cookie);
+    void cancel_timeout(uint64_t cookie);
+    void cancel(uint64_t cookie);
+
+    /* Submit queued operations */
+    void submit(void);
+
+    /* Submit queued operations and reap completions, waiting for at least
+     * one if block is set */
+    unsigned int wait(Event *events, unsigned int max, bool block);
+};
+
+#endif /* MUTATED_URING_HH */
@@ -0,0 +1,57 @@
+#ifndef MUTATED_VARINT_HH
+#define MUTATED_VARINT_HH
+
+/**
+ * varint.hh - unsigned LEB128 variable-length integers, as used by the binary
+ * file formats (traces, histograms and sample dumps).
+ */
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+/* Encode a varint into a buffer of at least 10 bytes, returning its size */
+inline std::size_t encode_varint(uint64_t v, char *buf) noexcept
+{
+    std::size_t n = 0;
+    do {
+        buf[n] = v & 0x7f;
+        v >>= 7;
+        if (v != 0) {
+            buf[n] |= 0x80;
+        }
+        n++;
+    } while (v != 0);
+    return n;
+}
+
+/* Write a varint to a stream */
+inline void write_varint(std::ostream &out, uint64_t v)
+{
+    char buf[10];
+    out.write(buf, encode_varint(v, buf));
+}
+
+/* Read a varint from a stream, false if the stream ends before it starts */
+inline bool read_varint(std::istream &in, uint64_t &v)
+{
+    v = 0;
+    for (unsigned int shift = 0;; shift += 7) {
+        int b = in.get();
+        if (b == std::istream::traits_type::eof()) {
+            if (shift == 0) {
+                return false;
+            }
+            throw std::runtime_error("read_varint: truncated varint");
+        } else if (shift > 63) {
+            throw std::runtime_error("read_varint: corrupt varint");
+        }
+        v |= uint64_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+}
+
+#endif /* MUTATED_VARINT_HH */